@@ -3,36 +3,32 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <inttypes.h>
 
-#define MAX_EVENTS 500  // Increased maximum events
-#define KEY_SIZE 32     // Stronger encryption key size
-#define DESCRIPTION_SIZE 200  // Larger description field
+#include "planner_engine.h"
 
-// Improved encryption key
-const char ENCRYPTION_KEY[KEY_SIZE] = "9f42cb71de86a0e415ad563ef28029ba";
+#define OUTPUT_BUFFER_SIZE 65536  // Rendering buffer, written out with one write() per flush
+#define PAGE_SIZE 20          // Events shown per page in the interactive viewer
+#define FUZZY_RESULTS 10      // Ranked results shown by fuzzy search
+#define CALENDAR_MEMORY_LIMIT ((size_t)256 << 20)  // Resident events across all open calendars
+#define MAX_AGENDA_CALENDARS 64  // Calendars that can be picked for one agenda
 
-typedef struct {
-    int id;
-    int day, month, year;
-    int hour, minute;
-    char description[DESCRIPTION_SIZE];
-    int priority;  // New: 1-5 priority level
-    char category[50];  // New: category field
-} Event;
+// The calendars in the current directory, and the selected one that the
+// menu works on; all storage goes through the engine
+PlannerCalendars *calendars = NULL;
+Planner *planner = NULL;
 
-typedef struct {
-    Event events[MAX_EVENTS];
-    int event_count;
-    int next_id;  // For unique ID assignment
-} Schedule;
-
-Schedule schedule = {.event_count = 0, .next_id = 1};
+// Output buffer shared by all list views
+char output_buffer[OUTPUT_BUFFER_SIZE];
+size_t output_length = 0;
 
 // Function prototypes
 void clear_input_buffer();
-int validate_date(int day, int month, int year);
-int validate_time(int hour, int minute);
-void xor_encrypt_decrypt(char *data, const char *key, size_t data_len);
+void show_engine_message();
 void add_event();
 void view_schedule();
 void view_today_events();
@@ -40,21 +36,56 @@ void sort_events();
 void delete_event();
 void save_schedule();
 void load_schedule();
+int decompress_file(const char *path);
+void toggle_compression();
+void sync_schedule();
+void check_external_changes();
+void report_conflict(int64_t id, const char *reason, const PlannerEvent *theirs, void *ctx);
 void search_events();
 void edit_event();
-void print_event(Event e, int index);
+void print_event(const PlannerEvent *e, int index);
+int print_match(const PlannerEvent *e, int index, void *ctx);
+char *append_number(char *p, int64_t value, int width);
+void output_flush();
+void output_reserve(size_t len);
+void output_append(const char *text, size_t len);
+void output_printf(const char *format, ...);
+void render_events(const PlannerEvent *events, int first, int last);
+int find_first_event_on_or_after(const PlannerEvent *events, int count, int day, int month, int year);
 void export_to_text();
 void show_statistics();
+void show_reports();
+void report_category_month(const PlannerReport *r, FILE *csv);
+void report_weekday_hour(const PlannerReport *r, FILE *csv);
+void report_priority_month(const PlannerReport *r, FILE *csv);
+void write_csv_field(FILE *fp, const char *text);
+void find_duplicates();
+int confirm_duplicate(const PlannerEvent *e);
+void show_calendar_message();
+void manage_calendars();
+void list_calendars();
+void show_agenda(int search);
+int print_agenda_event(const PlannerEvent *e, int calendar, int index, void *ctx);
 void help();
 
-int main() {
+int main(int argc, char *argv[]) {
     int choice = 0;
 
+    // Non-interactive helper for reading compressed exports
+    if (argc == 3 && strcmp(argv[1], "--decompress") == 0) {
+        return decompress_file(argv[2]) ? 0 : 1;
+    }
+
     // Try to load existing schedule on startup
     load_schedule();
+    if (!planner) {
+        printf("Not enough memory to open the schedule.\n");
+        return 1;
+    }
 
     while (1) {
-        printf("\n===== SCHEDULE MANAGER =====\n");
+        printf("\n===== SCHEDULE MANAGER [%s] =====\n",
+               planner_calendar_name(calendars, planner_calendar_selected(calendars)));
         printf("1. Add Event\n");
         printf("2. View All Events\n");
         printf("3. View Today's Events\n");
@@ -66,19 +97,35 @@ int main() {
         printf("9. Export to Text File\n");
         printf("10. Show Statistics\n");
         printf("11. Help\n");
+        printf("12. Toggle Compression\n");
+        printf("13. Sync With Another Copy\n");
+        printf("14. Workload Reports\n");
+        printf("15. Find Duplicates\n");
+        printf("16. Calendars\n");
         printf("0. Exit\n");
         printf("Choice: ");
 
-        if (scanf("%d", &choice) != 1) {
+        int status = scanf("%d", &choice);
+        if (status == EOF) {
+            // Input closed: treat like Exit instead of looping forever
+            choice = 0;
+        } else if (status != 1) {
             printf("Invalid input. Please enter a number.\n");
             clear_input_buffer();
             continue;
         }
 
+        // Pick up anything another planner saved while we waited for input
+        check_external_changes();
+
         switch (choice) {
             case 0:
                 printf("Saving schedule before exit...\n");
-                save_schedule();
+                if (planner_calendars_save(calendars)) {
+                    printf("Schedule saved successfully.\n");
+                }
+                show_calendar_message();
+                planner_calendars_close(calendars);
                 printf("Goodbye!\n");
                 return 0;
             case 1:
@@ -114,6 +161,21 @@ int main() {
             case 11:
                 help();
                 break;
+            case 12:
+                toggle_compression();
+                break;
+            case 13:
+                sync_schedule();
+                break;
+            case 14:
+                show_reports();
+                break;
+            case 15:
+                find_duplicates();
+                break;
+            case 16:
+                manage_calendars();
+                break;
             default:
                 printf("Invalid choice. Please try again.\n");
         }
@@ -127,42 +189,18 @@ void clear_input_buffer() {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
-// Date validation function
-int validate_date(int day, int month, int year) {
-    if (year < 2000 || year > 2100) return 0;
-    if (month < 1 || month > 12) return 0;
-
-    int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-
-    // Adjust for leap years
-    if ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)) {
-        days_in_month[2] = 29;
-    }
-
-    return (day >= 1 && day <= days_in_month[month]);
-}
-
-// Time validation function
-int validate_time(int hour, int minute) {
-    return (hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59);
-}
-
-// Improved encryption function
-void xor_encrypt_decrypt(char *data, const char *key, size_t data_len) {
-    size_t key_len = strlen(key);
-    for (size_t i = 0; i < data_len; i++) {
-        data[i] ^= key[i % key_len];
+// Print (and clear) any error or warning the engine left behind
+void show_engine_message() {
+    const char *message = planner_last_message(planner);
+    if (message[0]) {
+        printf("%s\n", message);
+        planner_clear_message(planner);
     }
 }
 
 void add_event() {
-    if (schedule.event_count >= MAX_EVENTS) {
-        printf("Event list full! Please delete some events first.\n");
-        return;
-    }
-
-    Event e;
-    e.id = schedule.next_id++;
+    PlannerEvent e;
+    memset(&e, 0, sizeof(e));
 
     int valid_date = 0;
     while (!valid_date) {
@@ -173,7 +211,7 @@ void add_event() {
             continue;
         }
 
-        if (validate_date(e.day, e.month, e.year)) {
+        if (planner_validate_date(e.day, e.month, e.year)) {
             valid_date = 1;
         } else {
             printf("Invalid date. Please try again.\n");
@@ -190,7 +228,7 @@ void add_event() {
             continue;
         }
 
-        if (validate_time(e.hour, e.minute)) {
+        if (planner_validate_time(e.hour, e.minute)) {
             valid_time = 1;
         } else {
             printf("Invalid time. Please try again.\n");
@@ -199,7 +237,7 @@ void add_event() {
 
     printf("Enter description: ");
     clear_input_buffer();
-    fgets(e.description, DESCRIPTION_SIZE, stdin);
+    fgets(e.description, PLANNER_DESCRIPTION_SIZE, stdin);
     e.description[strcspn(e.description, "\n")] = 0; // remove newline
 
     int valid_priority = 0;
@@ -220,34 +258,231 @@ void add_event() {
 
     printf("Enter category: ");
     clear_input_buffer();
-    fgets(e.category, 50, stdin);
+    fgets(e.category, PLANNER_CATEGORY_SIZE, stdin);
     e.category[strcspn(e.category, "\n")] = 0; // remove newline
+    e.category[strcspn(e.category, "|")] = 0;  // '|' separates fields on disk
+
+    if (!confirm_duplicate(&e)) {
+        printf("Event not added.\n");
+        return;
+    }
+
+    if (planner_add_many(planner, &e, 1) != 1) {
+        show_engine_message();
+        return;
+    }
+    printf("Event added successfully with ID: %" PRId64 "\n", e.id);
+}
+
+// Write the buffered output to stdout with as few write() calls as possible
+void output_flush() {
+    // Anything printed with printf must reach the terminal first
+    fflush(stdout);
+
+    size_t written = 0;
+    while (written < output_length) {
+        ssize_t n = write(STDOUT_FILENO, output_buffer + written, output_length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += (size_t)n;
+    }
+    output_length = 0;
+}
+
+// Make sure at least len bytes are free, flushing if necessary
+void output_reserve(size_t len) {
+    if (output_length + len > OUTPUT_BUFFER_SIZE) {
+        output_flush();
+    }
+}
+
+void output_append(const char *text, size_t len) {
+    if (len > OUTPUT_BUFFER_SIZE) {
+        output_flush();
+        fwrite(text, 1, len, stdout);
+        return;
+    }
+    output_reserve(len);
+    memcpy(output_buffer + output_length, text, len);
+    output_length += len;
+}
+
+void output_printf(const char *format, ...) {
+    char line[512];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
 
-    schedule.events[schedule.event_count++] = e;
-    printf("Event added successfully with ID: %d\n", e.id);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(line)) len = sizeof(line) - 1;
+    output_append(line, (size_t)len);
 }
 
-void print_event(Event e, int index) {
-    char priority_indicator[6] = "     ";
-    for (int i = 0; i < e.priority; i++) {
-        priority_indicator[i] = '*';
+// Append a zero-padded unsigned number of at least width digits
+char *append_number(char *p, int64_t value, int width) {
+    char digits[24];
+    int n = 0;
+    uint64_t v = value < 0 ? 0u - (uint64_t)value : (uint64_t)value;
+
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    while (n < width) digits[n++] = '0';
+    if (value < 0) *p++ = '-';
+    while (n > 0) *p++ = digits[--n];
+    return p;
+}
+
+// Format one event into the output buffer (formatted by hand, no printf)
+void print_event(const PlannerEvent *e, int index) {
+    size_t desc_len = strnlen(e->description, PLANNER_DESCRIPTION_SIZE);
+    size_t cat_len = strnlen(e->category, PLANNER_CATEGORY_SIZE);
+
+    output_reserve(64 + desc_len + cat_len);
+    char *p = output_buffer + output_length;
+
+    *p++ = '#';
+    p = append_number(p, index, 1);
+    memcpy(p, " [ID: ", 6); p += 6;
+    p = append_number(p, e->id, 1);
+    *p++ = ']'; *p++ = ' ';
+    p = append_number(p, e->day, 2); *p++ = '/';
+    p = append_number(p, e->month, 2); *p++ = '/';
+    p = append_number(p, e->year, 4); *p++ = ' ';
+    p = append_number(p, e->hour, 2); *p++ = ':';
+    p = append_number(p, e->minute, 2); *p++ = ' ';
+    for (int i = 0; i < 5; i++) {
+        *p++ = i < e->priority ? '*' : ' ';
     }
+    memcpy(p, " - ", 3); p += 3;
+    memcpy(p, e->description, desc_len); p += desc_len;
+    *p++ = ' '; *p++ = '[';
+    memcpy(p, e->category, cat_len); p += cat_len;
+    *p++ = ']'; *p++ = '\n';
+
+    output_length = (size_t)(p - output_buffer);
+}
+
+// Query callback that renders each match
+int print_match(const PlannerEvent *e, int index, void *ctx) {
+    (void)ctx;
+    print_event(e, index);
+    return 1;
+}
 
-    printf("#%d [ID: %d] %02d/%02d/%04d %02d:%02d %s - %s [%s]\n",
-           index, e.id, e.day, e.month, e.year,
-           e.hour, e.minute, priority_indicator,
-           e.description, e.category);
+void render_events(const PlannerEvent *events, int first, int last) {
+    for (int i = first; i < last; i++) {
+        print_event(&events[i], i);
+    }
+}
+
+// Binary search for the first event on or after the given date (events must be sorted by date)
+int find_first_event_on_or_after(const PlannerEvent *events, int count, int day, int month, int year) {
+    PlannerEvent key = {0};
+    key.day = day;
+    key.month = month;
+    key.year = year;
+
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (planner_compare_events(&events[mid], &key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
 
 void view_schedule() {
-    if (schedule.event_count == 0) {
+    planner_load_all(planner);
+    show_engine_message();
+
+    int count;
+    PlannerEvent *events = planner_events(planner, &count);
+
+    if (count == 0) {
         printf("No events scheduled.\n");
         return;
     }
 
-    printf("\n===== ALL EVENTS =====\n");
-    for (int i = 0; i < schedule.event_count; i++) {
-        print_event(schedule.events[i], i);
+    // When output is piped or redirected, stream everything without paging
+    if (!isatty(STDOUT_FILENO)) {
+        output_printf("\n===== ALL EVENTS =====\n");
+        render_events(events, 0, count);
+        output_flush();
+        return;
+    }
+
+    int first = 0;
+
+    while (1) {
+        int last = first + PAGE_SIZE < count ? first + PAGE_SIZE : count;
+        output_printf("\n===== ALL EVENTS (%d-%d of %d) =====\n", first + 1, last, count);
+        render_events(events, first, last);
+        output_printf("[n]ext  [p]rev  [j]ump to date  [q]uit: ");
+        output_flush();
+
+        char command;
+        if (scanf(" %c", &command) != 1) {
+            clear_input_buffer();
+            return;
+        }
+
+        switch (tolower(command)) {
+            case 'n':
+                if (first + PAGE_SIZE < count) {
+                    first += PAGE_SIZE;
+                } else {
+                    printf("Already on the last page.\n");
+                }
+                break;
+            case 'p':
+                if (first > 0) {
+                    first = first > PAGE_SIZE ? first - PAGE_SIZE : 0;
+                } else {
+                    printf("Already on the first page.\n");
+                }
+                break;
+            case 'j': {
+                int day, month, year;
+                printf("Jump to date (DD MM YYYY): ");
+                if (scanf("%d %d %d", &day, &month, &year) != 3 ||
+                    !planner_validate_date(day, month, year)) {
+                    printf("Invalid date.\n");
+                    clear_input_buffer();
+                    break;
+                }
+
+                // Jumping needs date order; only sort if the schedule isn't already sorted
+                for (int i = 1; i < count; i++) {
+                    if (planner_compare_events(&events[i - 1], &events[i]) > 0) {
+                        planner_sort(planner, PLANNER_SORT_DATE);
+                        printf("Events sorted by date and time.\n");
+                        break;
+                    }
+                }
+
+                int index = find_first_event_on_or_after(events, count, day, month, year);
+                if (index >= count) {
+                    printf("No events on or after that date.\n");
+                    index = count - 1;
+                }
+                first = index;
+                break;
+            }
+            case 'q':
+                clear_input_buffer();
+                return;
+            default:
+                printf("Invalid choice.\n");
+        }
     }
 }
 
@@ -258,45 +493,30 @@ void view_today_events() {
     int today_month = t->tm_mon + 1;
     int today_year = t->tm_year + 1900;
 
+    PlannerQuery query = {
+        .from_day = today_day, .from_month = today_month, .from_year = today_year,
+        .to_day = today_day, .to_month = today_month, .to_year = today_year,
+    };
+
     printf("\n===== TODAY'S EVENTS (%02d/%02d/%04d) =====\n",
            today_day, today_month, today_year);
 
-    int found = 0;
-    for (int i = 0; i < schedule.event_count; i++) {
-        if (schedule.events[i].day == today_day &&
-            schedule.events[i].month == today_month &&
-            schedule.events[i].year == today_year) {
-            print_event(schedule.events[i], i);
-            found++;
-        }
-    }
+    int found = planner_query(planner, &query, print_match, NULL);
+    output_flush();
+    show_engine_message();
 
     if (!found) {
         printf("No events scheduled for today.\n");
     }
 }
 
-// Compare function for sorting events by date and time
-int compare_events(const void *a, const void *b) {
-    Event *e1 = (Event *)a;
-    Event *e2 = (Event *)b;
-
-    if (e1->year != e2->year) return e1->year - e2->year;
-    if (e1->month != e2->month) return e1->month - e2->month;
-    if (e1->day != e2->day) return e1->day - e2->day;
-    if (e1->hour != e2->hour) return e1->hour - e2->hour;
-    return e1->minute - e2->minute;
-}
-
-// Compare function for sorting events by priority
-int compare_events_priority(const void *a, const void *b) {
-    Event *e1 = (Event *)a;
-    Event *e2 = (Event *)b;
-    return e1->priority - e2->priority;
-}
-
 void sort_events() {
-    if (schedule.event_count == 0) {
+    planner_load_all(planner);
+    show_engine_message();
+
+    int count;
+    planner_events(planner, &count);
+    if (count == 0) {
         printf("No events to sort.\n");
         return;
     }
@@ -315,11 +535,11 @@ void sort_events() {
 
     switch (sort_choice) {
         case 1:
-            qsort(schedule.events, schedule.event_count, sizeof(Event), compare_events);
+            planner_sort(planner, PLANNER_SORT_DATE);
             printf("Events sorted by date and time.\n");
             break;
         case 2:
-            qsort(schedule.events, schedule.event_count, sizeof(Event), compare_events_priority);
+            planner_sort(planner, PLANNER_SORT_PRIORITY);
             printf("Events sorted by priority.\n");
             break;
         default:
@@ -328,136 +548,145 @@ void sort_events() {
 }
 
 void delete_event() {
-    if (schedule.event_count == 0) {
+    if (planner_total_count(planner) == 0) {
         printf("No events to delete.\n");
         return;
     }
 
     view_schedule();
 
-    int id_to_delete;
+    int64_t id_to_delete;
     printf("Enter event ID to delete: ");
-    if (scanf("%d", &id_to_delete) != 1) {
+    if (scanf("%" SCNd64, &id_to_delete) != 1) {
         printf("Invalid input.\n");
         clear_input_buffer();
         return;
     }
 
-    int found = 0;
-    for (int i = 0; i < schedule.event_count; i++) {
-        if (schedule.events[i].id == id_to_delete) {
+    int count;
+    const PlannerEvent *events = planner_events(planner, &count);
+    for (int i = 0; i < count; i++) {
+        if (events[i].id == id_to_delete) {
             printf("Deleting event: ");
-            print_event(schedule.events[i], i);
-
-            // Shift all events down to fill the gap
-            for (int j = i; j < schedule.event_count - 1; j++) {
-                schedule.events[j] = schedule.events[j + 1];
-            }
-            schedule.event_count--;
-            found = 1;
+            print_event(&events[i], i);
+            output_flush();
             break;
         }
     }
 
-    if (found) {
+    if (planner_delete_many(planner, &id_to_delete, 1) == 1) {
         printf("Event deleted successfully.\n");
     } else {
         printf("Event ID not found.\n");
     }
 }
 
-void save_schedule() {
-    FILE *fp = fopen("schedule.dat", "wb");
-    if (!fp) {
-        printf("Error opening file for writing.\n");
-        return;
+// Read a compressed export and write its text to stdout
+int decompress_file(const char *path) {
+    char *text;
+    size_t len;
+    if (!planner_read_compressed_file(path, &text, &len)) {
+        fprintf(stderr, "%s is not a readable compressed planner file.\n", path);
+        return 0;
     }
 
-    // First write the event count and next ID
-    fprintf(fp, "%d %d\n", schedule.event_count, schedule.next_id);
-
-    // Then write each event
-    for (int i = 0; i < schedule.event_count; i++) {
-        Event e = schedule.events[i];
+    output_append(text, len);
+    output_flush();
+    free(text);
+    return 1;
+}
 
-        // Format the data as a string
-        char buffer[512];
-        sprintf(buffer, "%d|%d|%d|%d|%d|%d|%d|%s|%s\n",
-                e.id, e.day, e.month, e.year, e.hour, e.minute,
-                e.priority, e.category, e.description);
+// Switch the storage format; every segment is rewritten on the next save
+void toggle_compression() {
+    planner_set_compression(planner, !planner_compression(planner));
+    show_engine_message();
 
-        // Encrypt the buffer
-        xor_encrypt_decrypt(buffer, ENCRYPTION_KEY, strlen(buffer));
+    printf("Compression %s. All segments will be rewritten on the next save.\n",
+           planner_compression(planner) ? "enabled" : "disabled");
+}
 
-        // Write to file
-        fwrite(buffer, sizeof(char), strlen(buffer), fp);
+void save_schedule() {
+    if (planner_save(planner)) {
+        printf("Schedule saved successfully.\n");
     }
-
-    fclose(fp);
-    printf("Schedule saved successfully.\n");
+    show_engine_message();
 }
 
 void load_schedule() {
-    FILE *fp = fopen("schedule.dat", "rb");
-    if (!fp) {
-        printf("No existing schedule file found.\n");
-        return;
-    }
+    calendars = planner_calendars_open(".", CALENDAR_MEMORY_LIMIT);
+    if (!calendars) return;
+    show_calendar_message();
 
-    // First read the event count and next ID
-    if (fscanf(fp, "%d %d\n", &schedule.event_count, &schedule.next_id) != 2) {
-        printf("Error reading schedule metadata.\n");
-        fclose(fp);
-        return;
-    }
+    planner = planner_calendar_select(calendars, 0);
+    if (!planner) return;
 
-    // Check if event count is valid
-    if (schedule.event_count > MAX_EVENTS) {
-        printf("Error: File contains too many events.\n");
-        fclose(fp);
+    // The engine explains a missing schedule or a legacy conversion
+    if (planner_last_message(planner)[0]) {
+        show_engine_message();
         return;
     }
 
-    // Buffer for reading encrypted lines
-    char buffer[512];
-    int event_index = 0;
-
-    // Read each event
-    while (event_index < schedule.event_count && fgets(buffer, sizeof(buffer), fp)) {
-        // Decrypt the buffer
-        xor_encrypt_decrypt(buffer, ENCRYPTION_KEY, strlen(buffer));
+    int count;
+    planner_events(planner, &count);
+    printf("Schedule loaded successfully. %d events found (%d loaded).\n",
+           planner_total_count(planner), count);
+}
 
-        Event *e = &schedule.events[event_index];
+void report_conflict(int64_t id, const char *reason, const PlannerEvent *theirs, void *ctx) {
+    (void)ctx;
+    printf("Conflict on event ID %" PRId64 ": %s\n", id, reason);
+    if (theirs) {
+        printf("  Other copy had: %02d/%02d/%04d %02d:%02d priority %d - %s [%s]\n",
+               theirs->day, theirs->month, theirs->year, theirs->hour, theirs->minute,
+               theirs->priority, theirs->description, theirs->category);
+    }
+}
 
-        // Parse the event data with safer parsing
-        char description_buffer[DESCRIPTION_SIZE] = {0};
-        char category_buffer[50] = {0};
+// Merge anything another planner saved to the same directory
+void check_external_changes() {
+    PlannerSyncReport report;
+    if (planner_reload(planner, &report, report_conflict, NULL)) {
+        printf("\nSchedule was changed by another process (%d months); "
+               "merged %d added, %d updated, %d deleted.\n",
+               report.partitions_differed, report.added_here, report.updated_here,
+               report.deleted_here);
+    }
+    show_engine_message();
+}
 
-        if (sscanf(buffer, "%d|%d|%d|%d|%d|%d|%d|%49[^|]|%199[^\n]",
-                  &e->id, &e->day, &e->month, &e->year,
-                  &e->hour, &e->minute, &e->priority,
-                  category_buffer, description_buffer) == 9) {
+void sync_schedule() {
+    char dir[256];
+    printf("Enter directory of the other schedule copy: ");
+    clear_input_buffer();
+    if (!fgets(dir, sizeof(dir), stdin)) return;
+    dir[strcspn(dir, "\n")] = 0;
 
-            strncpy(e->category, category_buffer, 49);
-            strncpy(e->description, description_buffer, DESCRIPTION_SIZE - 1);
-            e->category[49] = '\0';
-            e->description[DESCRIPTION_SIZE - 1] = '\0';
+    printf("Saving local changes before sync...\n");
 
-            event_index++;
-        } else {
-            printf("Warning: Skipped invalid event record.\n");
-        }
+    PlannerSyncReport report;
+    int ok = planner_sync(planner, dir, &report, report_conflict, NULL);
+    show_engine_message();
+    if (!ok) {
+        printf("Sync did not complete.\n");
+        return;
     }
 
-    // Update event count in case some events were invalid
-    schedule.event_count = event_index;
+    if (report.partitions_differed == 0) {
+        printf("Already in sync (%d partitions compared).\n", report.partitions_compared);
+        return;
+    }
 
-    fclose(fp);
-    printf("Schedule loaded successfully. %d events found.\n", schedule.event_count);
+    printf("Sync complete: %d of %d partitions differed.\n",
+           report.partitions_differed, report.partitions_compared);
+    printf("This copy: %d added, %d updated, %d deleted. Other copy: %d changes sent.\n",
+           report.added_here, report.updated_here, report.deleted_here, report.sent);
+    if (report.conflicts) {
+        printf("%d conflicts reported above.\n", report.conflicts);
+    }
 }
 
 void search_events() {
-    if (schedule.event_count == 0) {
+    if (planner_total_count(planner) == 0) {
         printf("No events to search.\n");
         return;
     }
@@ -467,6 +696,7 @@ void search_events() {
     printf("1. Search by keyword\n");
     printf("2. Search by date\n");
     printf("3. Search by category\n");
+    printf("4. Fuzzy search (tolerates typos, best matches first)\n");
     printf("Choice: ");
 
     if (scanf("%d", &search_choice) != 1) {
@@ -475,6 +705,9 @@ void search_events() {
         return;
     }
 
+    PlannerQuery query;
+    memset(&query, 0, sizeof(query));
+
     switch (search_choice) {
         case 1: {
             char keyword[100];
@@ -483,35 +716,13 @@ void search_events() {
             fgets(keyword, 100, stdin);
             keyword[strcspn(keyword, "\n")] = 0;
 
-            // Convert keyword to lowercase for case-insensitive search
-            for (int i = 0; keyword[i]; i++) {
-                keyword[i] = tolower(keyword[i]);
-            }
+            // Matches the description or category, ignoring case
+            query.keyword = keyword;
 
             printf("\n===== SEARCH RESULTS =====\n");
-            int found = 0;
-
-            for (int i = 0; i < schedule.event_count; i++) {
-                // Make lowercase copies for case-insensitive comparison
-                char desc_lower[DESCRIPTION_SIZE];
-                char cat_lower[50];
-
-                strncpy(desc_lower, schedule.events[i].description, DESCRIPTION_SIZE);
-                strncpy(cat_lower, schedule.events[i].category, 50);
-
-                for (int j = 0; desc_lower[j]; j++) {
-                    desc_lower[j] = tolower(desc_lower[j]);
-                }
-
-                for (int j = 0; cat_lower[j]; j++) {
-                    cat_lower[j] = tolower(cat_lower[j]);
-                }
-
-                if (strstr(desc_lower, keyword) || strstr(cat_lower, keyword)) {
-                    print_event(schedule.events[i], i);
-                    found++;
-                }
-            }
+            int found = planner_query(planner, &query, print_match, NULL);
+            output_flush();
+            show_engine_message();
 
             if (!found) {
                 printf("No matching events found.\n");
@@ -529,22 +740,20 @@ void search_events() {
                 return;
             }
 
-            if (!validate_date(day, month, year)) {
+            if (!planner_validate_date(day, month, year)) {
                 printf("Invalid date.\n");
                 return;
             }
 
+            // Only the month containing this date needs to be resident
+            query.from_day = query.to_day = day;
+            query.from_month = query.to_month = month;
+            query.from_year = query.to_year = year;
+
             printf("\n===== EVENTS ON %02d/%02d/%04d =====\n", day, month, year);
-            int found = 0;
-
-            for (int i = 0; i < schedule.event_count; i++) {
-                if (schedule.events[i].day == day &&
-                    schedule.events[i].month == month &&
-                    schedule.events[i].year == year) {
-                    print_event(schedule.events[i], i);
-                    found++;
-                }
-            }
+            int found = planner_query(planner, &query, print_match, NULL);
+            output_flush();
+            show_engine_message();
 
             if (!found) {
                 printf("No events found on this date.\n");
@@ -552,37 +761,48 @@ void search_events() {
             break;
         }
         case 3: {
-            char category[50];
+            char category[PLANNER_CATEGORY_SIZE];
             printf("Enter category to search: ");
             clear_input_buffer();
-            fgets(category, 50, stdin);
+            fgets(category, PLANNER_CATEGORY_SIZE, stdin);
             category[strcspn(category, "\n")] = 0;
 
-            // Convert category to lowercase for case-insensitive search
-            for (int i = 0; category[i]; i++) {
-                category[i] = tolower(category[i]);
-            }
+            query.category = category;
 
             printf("\n===== EVENTS IN CATEGORY =====\n");
-            int found = 0;
+            int found = planner_query(planner, &query, print_match, NULL);
+            output_flush();
+            show_engine_message();
 
-            for (int i = 0; i < schedule.event_count; i++) {
-                char cat_lower[50];
-                strncpy(cat_lower, schedule.events[i].category, 50);
+            if (!found) {
+                printf("No events found in this category.\n");
+            }
+            break;
+        }
+        case 4: {
+            char text[100];
+            printf("Enter words to search for: ");
+            clear_input_buffer();
+            fgets(text, 100, stdin);
+            text[strcspn(text, "\n")] = 0;
 
-                for (int j = 0; cat_lower[j]; j++) {
-                    cat_lower[j] = tolower(cat_lower[j]);
-                }
+            PlannerMatch matches[FUZZY_RESULTS];
+            int found = planner_fuzzy_search(planner, text, matches, FUZZY_RESULTS);
+            show_engine_message();
 
-                if (strstr(cat_lower, category)) {
-                    print_event(schedule.events[i], i);
-                    found++;
-                }
+            if (!found) {
+                printf("No matching events found.\n");
+                break;
             }
 
-            if (!found) {
-                printf("No events found in this category.\n");
+            // Ranked by match quality, priority and closeness to today
+            int count;
+            const PlannerEvent *events = planner_events(planner, &count);
+            printf("\n===== BEST MATCHES =====\n");
+            for (int i = 0; i < found; i++) {
+                print_event(&events[matches[i].index], matches[i].index);
             }
+            output_flush();
             break;
         }
         default:
@@ -591,40 +811,42 @@ void search_events() {
 }
 
 void edit_event() {
-    if (schedule.event_count == 0) {
+    if (planner_total_count(planner) == 0) {
         printf("No events to edit.\n");
         return;
     }
 
     view_schedule();
 
-    int id_to_edit;
+    int64_t id_to_edit;
     printf("Enter event ID to edit: ");
-    if (scanf("%d", &id_to_edit) != 1) {
+    if (scanf("%" SCNd64, &id_to_edit) != 1) {
         printf("Invalid input.\n");
         clear_input_buffer();
         return;
     }
 
-    int found = 0;
-    int index = 0;
+    int count;
+    const PlannerEvent *events = planner_events(planner, &count);
+    int index = -1;
 
-    for (int i = 0; i < schedule.event_count; i++) {
-        if (schedule.events[i].id == id_to_edit) {
-            found = 1;
+    for (int i = 0; i < count; i++) {
+        if (events[i].id == id_to_edit) {
             index = i;
             break;
         }
     }
 
-    if (!found) {
+    if (index < 0) {
         printf("Event ID not found.\n");
         return;
     }
 
-    Event *e = &schedule.events[index];
+    // Edit a copy; the engine moves it between months if the date changes
+    PlannerEvent e = events[index];
     printf("Editing event: ");
-    print_event(*e, index);
+    print_event(&e, index);
+    output_flush();
 
     int edit_choice;
     printf("\n===== EDIT OPTIONS =====\n");
@@ -642,6 +864,8 @@ void edit_event() {
         return;
     }
 
+    const char *updated = NULL;
+
     switch (edit_choice) {
         case 0:
             printf("Edit cancelled.\n");
@@ -655,11 +879,11 @@ void edit_event() {
                 return;
             }
 
-            if (validate_date(day, month, year)) {
-                e->day = day;
-                e->month = month;
-                e->year = year;
-                printf("Date updated.\n");
+            if (planner_validate_date(day, month, year)) {
+                e.day = day;
+                e.month = month;
+                e.year = year;
+                updated = "Date updated.";
             } else {
                 printf("Invalid date. No changes made.\n");
             }
@@ -674,10 +898,10 @@ void edit_event() {
                 return;
             }
 
-            if (validate_time(hour, minute)) {
-                e->hour = hour;
-                e->minute = minute;
-                printf("Time updated.\n");
+            if (planner_validate_time(hour, minute)) {
+                e.hour = hour;
+                e.minute = minute;
+                updated = "Time updated.";
             } else {
                 printf("Invalid time. No changes made.\n");
             }
@@ -686,9 +910,9 @@ void edit_event() {
         case 3: {
             printf("Enter new description: ");
             clear_input_buffer();
-            fgets(e->description, DESCRIPTION_SIZE, stdin);
-            e->description[strcspn(e->description, "\n")] = 0;
-            printf("Description updated.\n");
+            fgets(e.description, PLANNER_DESCRIPTION_SIZE, stdin);
+            e.description[strcspn(e.description, "\n")] = 0;
+            updated = "Description updated.";
             break;
         }
         case 4: {
@@ -701,8 +925,8 @@ void edit_event() {
             }
 
             if (priority >= 1 && priority <= 5) {
-                e->priority = priority;
-                printf("Priority updated.\n");
+                e.priority = priority;
+                updated = "Priority updated.";
             } else {
                 printf("Invalid priority. No changes made.\n");
             }
@@ -711,18 +935,32 @@ void edit_event() {
         case 5: {
             printf("Enter new category: ");
             clear_input_buffer();
-            fgets(e->category, 50, stdin);
-            e->category[strcspn(e->category, "\n")] = 0;
-            printf("Category updated.\n");
+            fgets(e.category, PLANNER_CATEGORY_SIZE, stdin);
+            e.category[strcspn(e.category, "\n")] = 0;
+            e.category[strcspn(e.category, "|")] = 0;
+            updated = "Category updated.";
             break;
         }
         default:
             printf("Invalid choice.\n");
     }
+
+    if (updated) {
+        if (planner_update(planner, &e)) {
+            printf("%s\n", updated);
+        } else {
+            show_engine_message();
+        }
+    }
 }
 
 void export_to_text() {
-    if (schedule.event_count == 0) {
+    planner_load_all(planner);
+    show_engine_message();
+
+    int count;
+    const PlannerEvent *events = planner_events(planner, &count);
+    if (count == 0) {
         printf("No events to export.\n");
         return;
     }
@@ -733,7 +971,16 @@ void export_to_text() {
     fgets(filename, 100, stdin);
     filename[strcspn(filename, "\n")] = 0;
 
-    FILE *fp = fopen(filename, "w");
+    char answer;
+    printf("Compress the export? (y/n): ");
+    int compress = scanf(" %c", &answer) == 1 && tolower(answer) == 'y';
+    clear_input_buffer();
+
+    // A compressed export is rendered in memory first and then written as a
+    // container (unencrypted); read it back with: planner --decompress FILE
+    char *text = NULL;
+    size_t text_len = 0;
+    FILE *fp = compress ? open_memstream(&text, &text_len) : fopen(filename, "w");
     if (!fp) {
         printf("Error opening file for writing.\n");
         return;
@@ -749,36 +996,50 @@ void export_to_text() {
            t->tm_hour, t->tm_min);
 
     // Sort events by date before exporting
-    qsort(schedule.events, schedule.event_count, sizeof(Event), compare_events);
+    planner_sort(planner, PLANNER_SORT_DATE);
 
-    for (int i = 0; i < schedule.event_count; i++) {
-        Event e = schedule.events[i];
+    for (int i = 0; i < count; i++) {
+        const PlannerEvent *e = &events[i];
 
         char priority_indicator[6] = "     ";
-        for (int j = 0; j < e.priority; j++) {
+        for (int j = 0; j < e->priority; j++) {
             priority_indicator[j] = '*';
         }
 
-        fprintf(fp, "Event #%d [ID: %d]\n", i+1, e.id);
-        fprintf(fp, "Date: %02d/%02d/%04d\n", e.day, e.month, e.year);
-        fprintf(fp, "Time: %02d:%02d\n", e.hour, e.minute);
-        fprintf(fp, "Priority: %s (%d/5)\n", priority_indicator, e.priority);
-        fprintf(fp, "Category: %s\n", e.category);
-        fprintf(fp, "Description: %s\n\n", e.description);
+        fprintf(fp, "Event #%d [ID: %" PRId64 "]\n", i+1, e->id);
+        fprintf(fp, "Date: %02d/%02d/%04d\n", e->day, e->month, e->year);
+        fprintf(fp, "Time: %02d:%02d\n", e->hour, e->minute);
+        fprintf(fp, "Priority: %s (%d/5)\n", priority_indicator, e->priority);
+        fprintf(fp, "Category: %s\n", e->category);
+        fprintf(fp, "Description: %s\n\n", e->description);
     }
 
     fclose(fp);
+    if (compress) {
+        int ok = planner_write_compressed_file(filename, text, text_len);
+        free(text);
+        if (!ok) {
+            printf("Error writing compressed export.\n");
+            return;
+        }
+    }
+
     printf("Schedule exported to %s successfully.\n", filename);
 }
 
 void show_statistics() {
-    if (schedule.event_count == 0) {
+    planner_load_all(planner);
+    show_engine_message();
+
+    int count;
+    const PlannerEvent *events = planner_events(planner, &count);
+    if (count == 0) {
         printf("No events to analyze.\n");
         return;
     }
 
     printf("\n===== SCHEDULE STATISTICS =====\n");
-    printf("Total events: %d\n", schedule.event_count);
+    printf("Total events: %d\n", count);
 
     // Get current date
     time_t now = time(NULL);
@@ -797,39 +1058,40 @@ void show_statistics() {
     int events_this_month = 0;
 
     // Count unique categories
-    char categories[MAX_EVENTS][50];
+    const char **categories = malloc((size_t)count * sizeof(char *));
     int category_count = 0;
 
-    for (int i = 0; i < schedule.event_count; i++) {
-        Event e = schedule.events[i];
+    for (int i = 0; i < count; i++) {
+        const PlannerEvent *e = &events[i];
 
         // Count by priority
-        priority_counts[e.priority - 1]++;
+        priority_counts[e->priority - 1]++;
 
         // Check if event is today
-        if (e.day == today_day && e.month == today_month && e.year == today_year) {
+        if (e->day == today_day && e->month == today_month && e->year == today_year) {
             events_today++;
         }
 
         // Check if event is this month
-        if (e.month == today_month && e.year == today_year) {
+        if (e->month == today_month && e->year == today_year) {
             events_this_month++;
         }
 
         // Check if category is unique
+        if (!categories) continue;
         int found = 0;
         for (int j = 0; j < category_count; j++) {
-            if (strcmp(e.category, categories[j]) == 0) {
+            if (strcmp(e->category, categories[j]) == 0) {
                 found = 1;
                 break;
             }
         }
 
-        if (!found && e.category[0] != '\0') {
-            strncpy(categories[category_count], e.category, 50);
-            category_count++;
+        if (!found && e->category[0] != '\0') {
+            categories[category_count++] = e->category;
         }
     }
+    free(categories);
 
     printf("Events today: %d\n", events_today);
     printf("Events this month: %d\n", events_this_month);
@@ -839,27 +1101,25 @@ void show_statistics() {
     for (int i = 0; i < 5; i++) {
         printf("Priority %d: %d events (%.1f%%)\n",
                i+1, priority_counts[i],
-               (float)priority_counts[i] / schedule.event_count * 100);
+               (float)priority_counts[i] / count * 100);
     }
 
-    // Find next event
-    if (schedule.event_count > 0) {
-        // Sort events first
-        qsort(schedule.events, schedule.event_count, sizeof(Event), compare_events);
+    // Sort events first
+    planner_sort(planner, PLANNER_SORT_DATE);
 
-        // Find next event from today
-        for (int i = 0; i < schedule.event_count; i++) {
-            Event e = schedule.events[i];
+    // Find next event from today
+    for (int i = 0; i < count; i++) {
+        const PlannerEvent *e = &events[i];
 
-            // Check if event is today or in the future
-            if ((e.year > today_year) ||
-                (e.year == today_year && e.month > today_month) ||
-                (e.year == today_year && e.month == today_month && e.day >= today_day)) {
+        // Check if event is today or in the future
+        if ((e->year > today_year) ||
+            (e->year == today_year && e->month > today_month) ||
+            (e->year == today_year && e->month == today_month && e->day >= today_day)) {
 
-                printf("\nNext upcoming event:\n");
-                print_event(e, i);
-                break;
-            }
+            printf("\nNext upcoming event:\n");
+            print_event(e, i);
+            output_flush();
+            break;
         }
     }
 }
@@ -870,14 +1130,538 @@ void help() {
 
     printf("MAIN FEATURES:\n");
     printf("1. Add Event - Create a new event with date, time, description, priority and category\n");
-    printf("2. View Events - Display all scheduled events\n");
+    printf("2. View Events - Browse all events a page at a time (next/prev/jump to date)\n");
     printf("3. View Today's Events - Show only events scheduled for today\n");
-    printf("4. Search Events - Find events by keyword, date or category\n");
+    printf("4. Search Events - Find events by keyword, date or category, or fuzzy search\n");
+    printf("   that tolerates typos and ranks the best matches first\n");
     printf("5. Edit Event - Modify an existing event's details\n");
     printf("6. Delete Event - Remove an event from the schedule\n");
     printf("7. Sort Events - Organize events by date/time or priority\n");
-    printf("8. Save Schedule - Store your events to a file\n");
+    printf("8. Save Schedule - Store changed months to their segment files\n");
     printf("9. Export to Text - Create a readable text file of your schedule\n");
     printf("10. Show Statistics - Display information about your events\n");
     printf("11. Help - Show this help information\n");
+    printf("12. Toggle Compression - Store segment files as compressed blocks\n");
+    printf("13. Sync - Merge changes with another copy of the schedule directory\n");
+    printf("14. Workload Reports - Events per category per month, busiest weekdays and\n");
+    printf("    hours, and priority mix per month, as a table or CSV file\n");
+    printf("15. Find Duplicates - List events at the same date and time with identical or\n");
+    printf("    nearly identical descriptions, then delete or merge the extra copies\n");
+    printf("    (Add Event also warns before adding a likely duplicate)\n");
+    printf("16. Calendars - Keep separate named calendars (such as work and personal),\n");
+    printf("    switch between them, and view or search several of them together\n");
+}
+
+void show_reports() {
+    PlannerReport report;
+    if (!planner_report(planner, &report)) {
+        show_engine_message();
+        return;
+    }
+    show_engine_message();
+
+    if (report.total == 0) {
+        printf("No events to analyze.\n");
+        planner_free_report(&report);
+        return;
+    }
+
+    int report_choice, format_choice;
+    printf("\n===== WORKLOAD REPORTS =====\n");
+    printf("1. Events per category per month\n");
+    printf("2. Busiest weekdays and hours\n");
+    printf("3. Priority mix per month\n");
+    printf("Choice: ");
+    if (scanf("%d", &report_choice) != 1 || report_choice < 1 || report_choice > 3) {
+        printf("Invalid choice.\n");
+        clear_input_buffer();
+        planner_free_report(&report);
+        return;
+    }
+
+    printf("Output as:\n");
+    printf("1. Table\n");
+    printf("2. CSV file\n");
+    printf("Choice: ");
+    if (scanf("%d", &format_choice) != 1 || format_choice < 1 || format_choice > 2) {
+        printf("Invalid choice.\n");
+        clear_input_buffer();
+        planner_free_report(&report);
+        return;
+    }
+
+    FILE *csv = NULL;
+    char filename[100];
+    if (format_choice == 2) {
+        printf("Enter filename for the CSV (e.g., report.csv): ");
+        clear_input_buffer();
+        fgets(filename, 100, stdin);
+        filename[strcspn(filename, "\n")] = 0;
+
+        csv = fopen(filename, "w");
+        if (!csv) {
+            printf("Error opening file for writing.\n");
+            planner_free_report(&report);
+            return;
+        }
+    }
+
+    switch (report_choice) {
+        case 1:
+            report_category_month(&report, csv);
+            break;
+        case 2:
+            report_weekday_hour(&report, csv);
+            break;
+        case 3:
+            report_priority_month(&report, csv);
+            break;
+    }
+
+    if (csv) {
+        if (fclose(csv) == 0) {
+            printf("Report written to %s.\n", filename);
+        } else {
+            printf("Error writing %s.\n", filename);
+        }
+    } else {
+        output_flush();
+    }
+    planner_free_report(&report);
+}
+
+// Quote a CSV field, doubling any quotes inside it
+void write_csv_field(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (; *text; text++) {
+        if (*text == '"') fputc('"', fp);
+        fputc(*text, fp);
+    }
+    fputc('"', fp);
+}
+
+// Months are rows and categories columns; tables cut names to 10 characters
+void report_category_month(const PlannerReport *r, FILE *csv) {
+    if (csv) {
+        fprintf(csv, "month");
+        for (int c = 0; c < r->category_count; c++) {
+            fputc(',', csv);
+            write_csv_field(csv, r->categories[c]);
+        }
+        fprintf(csv, ",total\n");
+    } else {
+        output_printf("\n===== EVENTS PER CATEGORY PER MONTH =====\nMonth   ");
+        for (int c = 0; c < r->category_count; c++) {
+            output_printf(" %10.10s", r->categories[c][0] ? r->categories[c] : "(none)");
+        }
+        output_printf(" %10s\n", "Total");
+    }
+
+    for (int m = 0; m < r->month_count; m++) {
+        int month_index = r->first_month - 1 + m;
+        int year = r->first_year + month_index / 12;
+        int month = month_index % 12 + 1;
+        int total = 0;
+
+        if (csv) {
+            fprintf(csv, "%04d-%02d", year, month);
+        } else {
+            output_printf("%04d-%02d ", year, month);
+        }
+        for (int c = 0; c < r->category_count; c++) {
+            int count = r->category_month[c * r->month_count + m];
+            total += count;
+            if (csv) {
+                fprintf(csv, ",%d", count);
+            } else {
+                output_printf(" %10d", count);
+            }
+        }
+        if (csv) {
+            fprintf(csv, ",%d\n", total);
+        } else {
+            output_printf(" %10d\n", total);
+        }
+    }
+}
+
+void report_weekday_hour(const PlannerReport *r, FILE *csv) {
+    static const char *weekdays[7] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    int hour_totals[24] = {0};
+    int busiest_day = 0, busiest_hour = 0;
+    int day_totals[7] = {0};
+
+    for (int d = 0; d < 7; d++) {
+        for (int h = 0; h < 24; h++) {
+            day_totals[d] += r->weekday_hour[d][h];
+            hour_totals[h] += r->weekday_hour[d][h];
+        }
+        if (day_totals[d] > day_totals[busiest_day]) busiest_day = d;
+    }
+    for (int h = 1; h < 24; h++) {
+        if (hour_totals[h] > hour_totals[busiest_hour]) busiest_hour = h;
+    }
+
+    if (csv) {
+        fprintf(csv, "weekday");
+        for (int h = 0; h < 24; h++) fprintf(csv, ",%02d", h);
+        fprintf(csv, ",total\n");
+        for (int d = 0; d < 7; d++) {
+            fprintf(csv, "%s", weekdays[d]);
+            for (int h = 0; h < 24; h++) fprintf(csv, ",%d", r->weekday_hour[d][h]);
+            fprintf(csv, ",%d\n", day_totals[d]);
+        }
+        return;
+    }
+
+    output_printf("\n===== EVENTS PER WEEKDAY AND HOUR =====\nDay   Total");
+    for (int h = 0; h < 24; h++) output_printf(" %4.2d", h);
+    output_printf("\n");
+    for (int d = 0; d < 7; d++) {
+        output_printf("%-4s %6d", weekdays[d], day_totals[d]);
+        for (int h = 0; h < 24; h++) output_printf(" %4d", r->weekday_hour[d][h]);
+        output_printf("\n");
+    }
+    output_printf("All  %6d", r->total);
+    for (int h = 0; h < 24; h++) output_printf(" %4d", hour_totals[h]);
+    output_printf("\n\nBusiest weekday: %s (%d events)\n", weekdays[busiest_day], day_totals[busiest_day]);
+    output_printf("Busiest hour: %02d:00-%02d:59 (%d events)\n",
+                  busiest_hour, busiest_hour, hour_totals[busiest_hour]);
+}
+
+void report_priority_month(const PlannerReport *r, FILE *csv) {
+    if (csv) {
+        fprintf(csv, "month,p1,p2,p3,p4,p5,total\n");
+    } else {
+        output_printf("\n===== PRIORITY MIX PER MONTH =====\n");
+        output_printf("Month         P1      P2      P3      P4      P5   Total\n");
+    }
+
+    for (int m = 0; m < r->month_count; m++) {
+        int month_index = r->first_month - 1 + m;
+        int year = r->first_year + month_index / 12;
+        int month = month_index % 12 + 1;
+        int total = 0;
+
+        if (csv) {
+            fprintf(csv, "%04d-%02d", year, month);
+        } else {
+            output_printf("%04d-%02d ", year, month);
+        }
+        for (int pr = 0; pr < 5; pr++) {
+            int count = r->priority_month[pr * r->month_count + m];
+            total += count;
+            if (csv) {
+                fprintf(csv, ",%d", count);
+            } else {
+                output_printf(" %7d", count);
+            }
+        }
+        if (csv) {
+            fprintf(csv, ",%d\n", total);
+        } else {
+            output_printf(" %7d\n", total);
+        }
+    }
+}
+
+// Warn when a new event looks like one already in the schedule. Returns 1 if
+// the event should be added.
+int confirm_duplicate(const PlannerEvent *e) {
+    double similarity;
+    int64_t duplicate_id = planner_find_duplicate_of(planner, e, &similarity);
+    if (duplicate_id == 0) return 1;
+
+    int count;
+    const PlannerEvent *events = planner_events(planner, &count);
+    for (int i = 0; i < count; i++) {
+        if (events[i].id == duplicate_id) {
+            printf("This looks like a duplicate (%.0f%% similar) of:\n", similarity * 100);
+            print_event(&events[i], i);
+            output_flush();
+            break;
+        }
+    }
+
+    char answer;
+    printf("Add it anyway? (y/n): ");
+    if (scanf(" %c", &answer) != 1) return 0;
+    clear_input_buffer();
+    return answer == 'y' || answer == 'Y';
+}
+
+void find_duplicates() {
+    PlannerDuplicate *pairs;
+    int count;
+    if (!planner_find_duplicates(planner, &pairs, &count)) {
+        show_engine_message();
+        return;
+    }
+    show_engine_message();
+
+    if (count == 0) {
+        printf("No duplicate events found.\n");
+        free(pairs);
+        return;
+    }
+
+    int event_count;
+    PlannerEvent *events = planner_events(planner, &event_count);
+
+    int groups = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || pairs[i].keep_id != pairs[i - 1].keep_id) {
+            output_printf("\nKeep:      ");
+            print_event(&events[pairs[i].keep_index], pairs[i].keep_index);
+            groups++;
+        }
+        if (pairs[i].exact) {
+            output_printf("  exact:   ");
+        } else {
+            output_printf("  %3.0f%%:    ", pairs[i].similarity * 100);
+        }
+        print_event(&events[pairs[i].duplicate_index], pairs[i].duplicate_index);
+    }
+    output_flush();
+    printf("\nFound %d duplicate events in %d groups.\n", count, groups);
+
+    int choice = -1;
+    printf("1. Delete all duplicates\n");
+    printf("2. Review each duplicate\n");
+    printf("0. Cancel\n");
+    printf("Choice: ");
+    if (scanf("%d", &choice) != 1 || choice < 1 || choice > 2) {
+        if (choice != 0) printf("Invalid choice.\n");
+        clear_input_buffer();
+        free(pairs);
+        return;
+    }
+
+    // Deletions are collected and applied together at the end so that the
+    // indices in pairs stay valid during the review
+    int64_t *delete_ids = malloc((size_t)count * sizeof(int64_t));
+    if (!delete_ids) {
+        printf("Not enough memory.\n");
+        free(pairs);
+        return;
+    }
+    int delete_count = 0, merged = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (choice == 1) {
+            delete_ids[delete_count++] = pairs[i].duplicate_id;
+            continue;
+        }
+
+        PlannerEvent *keep = &events[pairs[i].keep_index];
+        const PlannerEvent *duplicate = &events[pairs[i].duplicate_index];
+        printf("\n");
+        print_event(keep, pairs[i].keep_index);
+        print_event(duplicate, pairs[i].duplicate_index);
+        output_flush();
+
+        char action;
+        printf("d = delete the second, m = merge it into the first, k = keep both, q = stop: ");
+        if (scanf(" %c", &action) != 1) break;
+        clear_input_buffer();
+
+        if (action == 'q' || action == 'Q') break;
+        if (action == 'd' || action == 'D') {
+            delete_ids[delete_count++] = pairs[i].duplicate_id;
+        } else if (action == 'm' || action == 'M') {
+            // Keep the higher priority and any details only the copy has
+            PlannerEvent merged_event = *keep;
+            if (duplicate->priority < merged_event.priority) {
+                merged_event.priority = duplicate->priority;
+            }
+            if (merged_event.category[0] == '\0') {
+                strcpy(merged_event.category, duplicate->category);
+            }
+            if (strlen(duplicate->description) > strlen(merged_event.description)) {
+                strcpy(merged_event.description, duplicate->description);
+            }
+            if (planner_update(planner, &merged_event)) {
+                delete_ids[delete_count++] = pairs[i].duplicate_id;
+                merged++;
+            } else {
+                show_engine_message();
+            }
+        }
+    }
+
+    int deleted = delete_count > 0 ? planner_delete_many(planner, delete_ids, delete_count) : 0;
+    if (merged > 0) {
+        printf("Merged %d duplicates into the events they copied.\n", merged);
+    }
+    printf("Deleted %d duplicate events.\n", deleted);
+
+    free(delete_ids);
+    free(pairs);
+}
+
+// Print (and clear) any error or warning about the set of calendars
+void show_calendar_message() {
+    const char *message = planner_calendars_last_message(calendars);
+    if (message[0]) {
+        printf("%s\n", message);
+        planner_calendars_clear_message(calendars);
+    }
+}
+
+void list_calendars() {
+    int selected = planner_calendar_selected(calendars);
+    printf("\n===== CALENDARS =====\n");
+    for (int i = 0; i < planner_calendar_count(calendars); i++) {
+        printf("%c %d. %s", i == selected ? '*' : ' ', i + 1, planner_calendar_name(calendars, i));
+        int count = planner_calendar_event_count(calendars, i);
+        if (count >= 0) {
+            printf(" (%d events)\n", count);
+        } else {
+            printf(" (not loaded)\n");
+        }
+    }
+}
+
+void manage_calendars() {
+    list_calendars();
+
+    int choice;
+    printf("\n1. Switch calendar\n");
+    printf("2. Create calendar\n");
+    printf("3. Combined agenda\n");
+    printf("4. Search all calendars\n");
+    printf("0. Back\n");
+    printf("Choice: ");
+    if (scanf("%d", &choice) != 1) {
+        printf("Invalid input.\n");
+        clear_input_buffer();
+        return;
+    }
+
+    switch (choice) {
+        case 0:
+            break;
+        case 1: {
+            int number;
+            printf("Enter calendar number: ");
+            if (scanf("%d", &number) != 1 || number < 1 || number > planner_calendar_count(calendars)) {
+                printf("Invalid calendar number.\n");
+                clear_input_buffer();
+                return;
+            }
+
+            Planner *selected = planner_calendar_select(calendars, number - 1);
+            show_calendar_message();
+            if (!selected) return;
+            planner = selected;
+            show_engine_message();
+            printf("Switched to calendar %s (%d events).\n",
+                   planner_calendar_name(calendars, number - 1), planner_total_count(planner));
+            break;
+        }
+        case 2: {
+            char name[100];
+            printf("Enter calendar name (letters, digits, '-' and '_'): ");
+            clear_input_buffer();
+            if (!fgets(name, sizeof(name), stdin)) return;
+            name[strcspn(name, "\n")] = 0;
+
+            int index = planner_calendar_create(calendars, name);
+            if (index < 0) {
+                show_calendar_message();
+                return;
+            }
+
+            Planner *selected = planner_calendar_select(calendars, index);
+            show_calendar_message();
+            if (!selected) return;
+            planner = selected;
+            printf("Calendar %s created and selected.\n", name);
+            break;
+        }
+        case 3:
+            show_agenda(0);
+            break;
+        case 4:
+            show_agenda(1);
+            break;
+        default:
+            printf("Invalid choice.\n");
+    }
+}
+
+// Agenda callback: tag each event with the calendar it came from
+int print_agenda_event(const PlannerEvent *e, int calendar, int index, void *ctx) {
+    (void)ctx;
+    output_printf("%-12s ", planner_calendar_name(calendars, calendar));
+    print_event(e, index);
+    return 1;
+}
+
+// Show the chosen calendars merged into one list in date order, either for
+// a date range (the agenda) or for a keyword across all calendars (search)
+void show_agenda(int search) {
+    PlannerQuery query;
+    memset(&query, 0, sizeof(query));
+    int chosen[MAX_AGENDA_CALENDARS];
+    int chosen_count = 0;
+    char line[256];
+
+    if (search) {
+        printf("Enter keyword to search: ");
+        clear_input_buffer();
+        if (!fgets(line, sizeof(line), stdin)) return;
+        line[strcspn(line, "\n")] = 0;
+        query.keyword = line;
+    } else {
+        printf("Calendars to combine (numbers separated by spaces, Enter for all): ");
+        clear_input_buffer();
+        if (!fgets(line, sizeof(line), stdin)) return;
+
+        char *p = line, *end;
+        long number;
+        while (chosen_count < MAX_AGENDA_CALENDARS && (number = strtol(p, &end, 10), end != p)) {
+            if (number < 1 || number > planner_calendar_count(calendars)) {
+                printf("Invalid calendar number: %ld\n", number);
+                return;
+            }
+            chosen[chosen_count++] = (int)number - 1;
+            p = end;
+        }
+
+        printf("From date (DD MM YYYY): ");
+        if (scanf("%d %d %d", &query.from_day, &query.from_month, &query.from_year) != 3 ||
+            !planner_validate_date(query.from_day, query.from_month, query.from_year)) {
+            printf("Invalid date.\n");
+            clear_input_buffer();
+            return;
+        }
+        printf("To date (DD MM YYYY): ");
+        if (scanf("%d %d %d", &query.to_day, &query.to_month, &query.to_year) != 3 ||
+            !planner_validate_date(query.to_day, query.to_month, query.to_year)) {
+            printf("Invalid date.\n");
+            clear_input_buffer();
+            return;
+        }
+    }
+
+    if (search) {
+        printf("\n===== RESULTS FROM ALL CALENDARS =====\n");
+    } else {
+        printf("\n===== AGENDA %02d/%02d/%04d - %02d/%02d/%04d =====\n",
+               query.from_day, query.from_month, query.from_year,
+               query.to_day, query.to_month, query.to_year);
+    }
+
+    int found = planner_agenda(calendars, chosen_count ? chosen : NULL, chosen_count, &query,
+                               print_agenda_event, NULL);
+    output_flush();
+    show_calendar_message();
+    show_engine_message();
+
+    if (!found) {
+        printf(search ? "No matching events found.\n" : "No events in this period.\n");
+    } else {
+        printf("Found %d events.\n", found);
+    }
 }
@@ -0,0 +1,4142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "planner_engine.h"
+
+#define KEY_SIZE 32     // Stronger encryption key size
+#define RECORD_SIZE 512       // Maximum length of one serialized event record
+#define MAX_THREADS 8         // Upper bound on the threads of any parallel pass
+
+// Time-partitioned storage: one segment file per month plus a small manifest
+#define MANIFEST_FILE "schedule.idx"
+#define LOCK_FILE "schedule.lock"  // flock()ed while segments and the manifest are written
+#define NODE_FILE "schedule.node"  // Device and inode of the directory that owns the node ID
+#define LEGACY_SCHEDULE_FILE "schedule.dat"
+#define NO_SCHEDULE_MESSAGE "No existing schedule file found."
+#define FIRST_YEAR 2000
+#define LAST_YEAR 2100
+#define PATH_SIZE (PATH_MAX + 64)  // Directory plus a segment or manifest file name
+#define MAX_SEGMENTS ((LAST_YEAR - FIRST_YEAR + 1) * 12)
+#define MAX_RESIDENT_SEGMENTS 24  // LRU cap on saved segments kept in memory (unsaved ones stay)
+
+// Event IDs carry the ID of the node (copy) that created them in their high
+// bits and a sequence number within that node in the low 32 bits, so copies
+// of a schedule can be merged without collisions
+#define ID_NODE_SHIFT 32
+#define ID_SEQUENCE_LIMIT ((int64_t)1 << ID_NODE_SHIFT)
+#define MAX_NODE_ID INT_MAX
+
+// Compressed container: LZ-compressed blocks of whole lines, each block
+// encrypted on its own so blocks can be decoded independently
+#define CONTAINER_MAGIC "PLZ1"
+#define BLOCK_SIZE 65536      // Uncompressed bytes per block (lines are never split)
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+
+// Fuzzy search: words are indexed by their padded trigrams
+#define MAX_WORD_LENGTH 32    // Longer words are truncated
+#define MAX_EVENT_WORDS 64    // Words indexed per event
+#define MAX_QUERY_TERMS 8
+#define FUZZY_MATCH_WEIGHT 70.0     // Score for matching every term exactly
+#define FUZZY_PRIORITY_WEIGHT 15.0  // Score for priority 1 (0 for priority 5)
+#define FUZZY_PROXIMITY_WEIGHT 15.0 // Score for an event today, decaying by week
+#define FUZZY_PREFIX_QUALITY 0.6f   // Match quality of a term that is a word prefix
+
+// Reports: each thread builds partial histograms over a slice of the events
+#define REPORT_EVENTS_PER_THREAD 65536  // Smaller slices are not worth a thread
+
+// Near-duplicate detection: MinHash over character shingles, with LSH bands
+#define SHINGLE_SIZE 3
+#define MAX_SHINGLES (PLANNER_DESCRIPTION_SIZE + PLANNER_CATEGORY_SIZE)
+#define MINHASH_COUNT 16
+#define LSH_BANDS 8
+#define LSH_ROWS (MINHASH_COUNT / LSH_BANDS)
+#define DUPLICATE_SIMILARITY 0.7  // Jaccard similarity of the shingles for a near duplicate
+
+// Named calendars: the directory itself is "main", the rest live in calendars/
+#define MAIN_CALENDAR "main"
+#define CALENDARS_DIR "calendars"
+#define CALENDAR_NAME_SIZE 32
+#define MAX_CALENDARS 64
+
+// Improved encryption key
+static const char ENCRYPTION_KEY[KEY_SIZE] = "9f42cb71de86a0e415ad563ef28029ba";
+
+// Growable array of events
+typedef struct {
+    PlannerEvent *events;
+    int count;
+    int capacity;
+} EventList;
+
+typedef struct {
+    int event_count;          // Events in this month (on disk, plus unsaved changes once loaded)
+    int on_disk;              // A segment file exists for this month
+    int loaded;               // Its events are present in the resident list
+    int dirty;                // Modified since it was last loaded or saved
+    unsigned long last_used;  // LRU clock value of the last query that touched it
+    uint64_t digest;          // Order-independent hash of the saved events (0 = unknown)
+    int has_base;             // base_* hold the saved events, taken when it became dirty
+    int base_count;
+    int64_t *base_ids;
+    uint64_t *base_hashes;
+} Segment;
+
+// On-disk manifest contents, used for this copy and for sync peers
+typedef struct {
+    int64_t next_id;
+    int compress;
+    int node_id;
+    unsigned long generation; // Bumped by every save, so other processes notice
+    unsigned char on_disk[MAX_SEGMENTS];
+    int event_count[MAX_SEGMENTS];
+    uint64_t digest[MAX_SEGMENTS];
+} Manifest;
+
+typedef struct FuzzyIndex FuzzyIndex;
+
+struct Planner {
+    char dir[PATH_MAX];       // Directory holding the manifest and segment files
+    EventList schedule;       // Events of the resident segments
+    int64_t next_id;          // Next sequence number within this node's ID range
+    int node_id;              // This copy's ID prefix (saved in the manifest)
+    int compress;             // Write segments as compressed containers
+    Segment segments[MAX_SEGMENTS];
+    unsigned long segment_clock;
+    unsigned long generation; // Bumped whenever events are added, changed or removed
+    FuzzyIndex *fuzzy;        // Word index for fuzzy search, built on demand
+    unsigned long disk_generation;  // Manifest generation last read or written
+    int lock_fd;              // Lock file, or -1
+    int lock_depth;           // Nesting of lock_schedule() calls
+    int watch_fd;             // inotify descriptor watching the directory, or -1
+    char message[256];        // Last error or warning
+};
+
+typedef struct {
+    uint32_t raw_size;        // Uncompressed size
+    uint32_t packed_size;     // Compressed (and possibly encrypted) size
+    uint32_t line_count;      // Newline-terminated lines (records) in the block
+} BlockHeader;
+
+// One block being decoded, possibly on its own thread
+typedef struct {
+    BlockHeader header;
+    unsigned char *packed;    // Points into the file contents read by the caller
+    char *raw;                // Decoded text (raw_size + 1 bytes)
+    int encrypted;
+    PlannerEvent *events;            // When non-NULL, parse the lines into this slot range
+    int segment;              // Segment every parsed record must belong to (-1 = any)
+    int parsed;               // Valid records written to events
+    int ok;
+} BlockJob;
+
+// Called on one item of a parallel pass
+typedef void (*ParallelTask)(void *item);
+
+typedef struct {
+    ParallelTask task;
+    char *items;
+    size_t item_size;
+    int first, step, count;
+} ParallelWorker;
+
+// Open-addressing map from event ID to an array index
+typedef struct {
+    int64_t *ids;             // 0 marks an empty slot (IDs start at 1)
+    int *values;
+    int capacity;             // Power of two
+} IdTable;
+
+// What both copies agreed on after the last sync with a given peer
+typedef struct {
+    uint64_t digest[MAX_SEGMENTS];  // Partition digests at that point
+    int entry_count;
+    int capacity;
+    int64_t *ids;             // Per-event ID, partition and content hash
+    int *segment;
+    uint64_t *hash;
+} SyncBase;
+
+// Internal function prototypes
+static void set_message(Planner *p, const char *format, ...);
+static void xor_encrypt_decrypt(char *data, const char *key, size_t data_len);
+static int list_reserve(EventList *list, int extra);
+static int format_record(char *buffer, size_t size, const PlannerEvent *e);
+static int parse_record(const char *buffer, PlannerEvent *e);
+static int segment_index(int year, int month);
+static void segment_path(char *path, size_t size, const char *dir, int index);
+static void manifest_path(char *path, size_t size, const char *dir);
+static uint64_t event_hash(const PlannerEvent *e);
+static uint64_t digest_add(uint64_t digest, uint64_t hash);
+static size_t lz_bound(size_t len);
+static size_t lz_compress(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_cap);
+static long lz_decompress(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_cap);
+static int write_container(FILE *fp, const char *data, size_t len, int encrypted);
+static BlockJob *read_container(FILE *fp, int *block_count);
+static void run_parallel(ParallelTask task, void *items, size_t item_size, int count);
+static void free_container(BlockJob *jobs, int block_count);
+static int read_segment_file(Planner *p, const char *path, int index, EventList *out, int *count);
+static int write_segment_file(Planner *p, const char *path, int index, const PlannerEvent *events,
+                              int event_count, int compress, uint64_t *digest);
+static int read_manifest_file(Planner *p, const char *dir, Manifest *m);
+static int write_manifest_file(Planner *p, const char *dir, const Manifest *m);
+static int load_segment(Planner *p, int index);
+static int save_segment(Planner *p, int index);
+static void evict_segment(Planner *p, int index);
+static int ensure_segment_set_loaded(Planner *p, const unsigned char *wanted);
+static int ensure_segments_loaded(Planner *p, int first_index, int last_index);
+static void mark_segment_dirty(Planner *p, int index);
+static void free_segment_base(Segment *seg);
+static int sync_base_add(SyncBase *base, int64_t id, int segment, uint64_t hash);
+static void free_sync_base(SyncBase *base);
+static int save_manifest(Planner *p);
+static int load_manifest(Planner *p);
+static int load_legacy_schedule(Planner *p);
+static void assign_node_id(Planner *p);
+static void check_node_owner(Planner *p, int have_manifest);
+static int split_node_id(Planner *p, const char *peer_dir, const Manifest *peer);
+static void adopt_manifest_ids(Planner *p, const Manifest *m);
+static int find_event(Planner *p, int64_t id);
+static void free_fuzzy_index(FuzzyIndex *index);
+static void lock_schedule(Planner *p, int operation);
+static void unlock_schedule(Planner *p);
+static int save_changes(Planner *p, int only_index);
+static int reload_changes(Planner *p, PlannerSyncReport *report,
+                          PlannerConflictCallback on_conflict, void *ctx);
+static int merge_partitions(Planner *p, const unsigned char *differs, const EventList *theirs,
+                            const SyncBase *base, PlannerSyncReport *report,
+                            PlannerConflictCallback on_conflict, void *ctx);
+static int id_table_init(IdTable *t, int expected);
+static void id_table_put(IdTable *t, int64_t id, int value);
+static int id_table_get(const IdTable *t, int64_t id);
+static void id_table_free(IdTable *t);
+
+// ---- Basics ----
+
+static void set_message(Planner *p, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(p->message, sizeof(p->message), format, args);
+    va_end(args);
+}
+
+const char *planner_last_message(const Planner *p) {
+    return p->message;
+}
+
+void planner_clear_message(Planner *p) {
+    p->message[0] = '\0';
+}
+
+// Date validation function
+int planner_validate_date(int day, int month, int year) {
+    if (year < FIRST_YEAR || year > LAST_YEAR) return 0;
+    if (month < 1 || month > 12) return 0;
+
+    int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    // Adjust for leap years
+    if ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)) {
+        days_in_month[2] = 29;
+    }
+
+    return (day >= 1 && day <= days_in_month[month]);
+}
+
+// Time validation function
+int planner_validate_time(int hour, int minute) {
+    return (hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59);
+}
+
+int planner_validate_event(const PlannerEvent *e) {
+    return planner_validate_date(e->day, e->month, e->year) &&
+           planner_validate_time(e->hour, e->minute) &&
+           e->priority >= 1 && e->priority <= 5 &&
+           memchr(e->description, '\0', PLANNER_DESCRIPTION_SIZE) != NULL &&
+           memchr(e->category, '\0', PLANNER_CATEGORY_SIZE) != NULL &&
+           strpbrk(e->category, "|\n") == NULL &&
+           strchr(e->description, '\n') == NULL;
+}
+
+// Improved encryption function
+static void xor_encrypt_decrypt(char *data, const char *key, size_t data_len) {
+    size_t key_len = strnlen(key, KEY_SIZE);  // The key is not NUL-terminated
+    for (size_t i = 0; i < data_len; i++) {
+        data[i] ^= key[i % key_len];
+    }
+}
+
+static int list_reserve(EventList *list, int extra) {
+    if (extra < 0 || extra > INT_MAX - list->count) return 0;
+    if (list->count + extra <= list->capacity) return 1;
+
+    int needed = list->count + extra;
+    int capacity = list->capacity ? list->capacity : 64;
+    while (capacity < needed) capacity = capacity > INT_MAX / 2 ? needed : capacity * 2;
+
+    PlannerEvent *grown = realloc(list->events, (size_t)capacity * sizeof(PlannerEvent));
+    if (!grown) return 0;
+    list->events = grown;
+    list->capacity = capacity;
+    return 1;
+}
+
+static void *parallel_worker(void *arg) {
+    ParallelWorker *w = arg;
+    for (int i = w->first; i < w->count; i += w->step) {
+        w->task(w->items + (size_t)i * w->item_size);
+    }
+    return NULL;
+}
+
+// Run task on each of count items, spread over as many threads as there are
+// CPUs (at most MAX_THREADS, and no more than items). The calling thread
+// takes a share, and also runs the share of any thread that fails to start.
+static void run_parallel(ParallelTask task, void *items, size_t item_size, int count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus > 0 ? (int)cpus : 1;
+    if (thread_count > MAX_THREADS) thread_count = MAX_THREADS;
+    if (thread_count > count) thread_count = count;
+    if (thread_count < 1) return;
+
+    pthread_t threads[MAX_THREADS];
+    ParallelWorker workers[MAX_THREADS];
+    int running[MAX_THREADS] = {0};
+    for (int t = 0; t < thread_count; t++) {
+        workers[t] = (ParallelWorker){task, items, item_size, t, thread_count, count};
+    }
+    for (int t = 1; t < thread_count; t++) {
+        if (pthread_create(&threads[t], NULL, parallel_worker, &workers[t]) == 0) {
+            running[t] = 1;
+        } else {
+            parallel_worker(&workers[t]);
+        }
+    }
+    parallel_worker(&workers[0]);
+    for (int t = 1; t < thread_count; t++) {
+        if (running[t]) pthread_join(threads[t], NULL);
+    }
+}
+
+// Serialize one event as a pipe-delimited record; returns its length
+static int format_record(char *buffer, size_t size, const PlannerEvent *e) {
+    int len = snprintf(buffer, size, "%" PRId64 "|%d|%d|%d|%d|%d|%d|%s|%s\n",
+                       e->id, e->day, e->month, e->year, e->hour, e->minute,
+                       e->priority, e->category, e->description);
+    if (len < 0 || (size_t)len >= size) return -1;
+    return len;
+}
+
+// Parse a decrypted record; returns 1 only for a complete, valid event, so
+// every reader skips records with out-of-range fields
+static int parse_record(const char *buffer, PlannerEvent *e) {
+    int fields_end = 0;
+    if (sscanf(buffer, "%" SCNd64 "|%d|%d|%d|%d|%d|%d|%n",
+               &e->id, &e->day, &e->month, &e->year,
+               &e->hour, &e->minute, &e->priority, &fields_end) != 7 || fields_end == 0) {
+        return 0;
+    }
+
+    // The category and the description may be empty, which sscanf's %[
+    // cannot match; the category ends at the next '|' (it never contains one)
+    const char *category = buffer + fields_end;
+    const char *separator = strchr(category, '|');
+    if (!separator) return 0;
+    const char *description = separator + 1;
+    size_t description_len = strcspn(description, "\n");
+
+    size_t category_len = (size_t)(separator - category);
+    if (category_len > PLANNER_CATEGORY_SIZE - 1) category_len = PLANNER_CATEGORY_SIZE - 1;
+    if (description_len > PLANNER_DESCRIPTION_SIZE - 1) description_len = PLANNER_DESCRIPTION_SIZE - 1;
+
+    memcpy(e->category, category, category_len);
+    e->category[category_len] = '\0';
+    memcpy(e->description, description, description_len);
+    e->description[description_len] = '\0';
+    return planner_validate_event(e);
+}
+
+static int segment_index(int year, int month) {
+    return (year - FIRST_YEAR) * 12 + (month - 1);
+}
+
+static void segment_path(char *path, size_t size, const char *dir, int index) {
+    snprintf(path, size, "%s/schedule-%04d-%02d.dat",
+             dir, FIRST_YEAR + index / 12, index % 12 + 1);
+}
+
+static void manifest_path(char *path, size_t size, const char *dir) {
+    snprintf(path, size, "%s/%s", dir, MANIFEST_FILE);
+}
+
+// FNV-1a over the serialized record, so any field change alters the hash
+static uint64_t event_hash(const PlannerEvent *e) {
+    char buffer[RECORD_SIZE];
+    int len = format_record(buffer, sizeof(buffer), e);
+    uint64_t h = 14695981039346656037ull;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)buffer[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Partition digests are sums of mixed event hashes, so they do not depend
+// on the order events are stored in
+static uint64_t digest_add(uint64_t digest, uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return digest + hash;
+}
+
+int planner_total_count(const Planner *p) {
+    int total = 0;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        total += p->segments[i].event_count;
+    }
+    return total;
+}
+
+int planner_compression(const Planner *p) {
+    return p->compress;
+}
+
+int planner_node_id(const Planner *p) {
+    return p->node_id;
+}
+
+// ---- Block compression ----
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Worst-case compressed size for an input of len bytes
+static size_t lz_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+static unsigned char *lz_put_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// LZ77 with an LZ4-style sequence layout: a token holding the literal and
+// match lengths, the literals, then a 16-bit offset. Matches are found with
+// a single-probe hash of the next four bytes.
+static size_t lz_compress(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_cap) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0};  // Position + 1 of the last occurrence
+    unsigned char *op = out;
+    size_t anchor = 0, ip = 0;
+
+    if (out_cap < lz_bound(in_len)) return 0;
+
+    // The last bytes are always emitted as literals
+    size_t match_limit = in_len > 12 ? in_len - 12 : 0;
+
+    while (ip < match_limit) {
+        uint32_t seq;
+        memcpy(&seq, in + ip, 4);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t ref = table[h];
+        table[h] = (uint32_t)(ip + 1);
+
+        if (ref == 0 || ip - (ref - 1) > 65535 || memcmp(in + ref - 1, in + ip, 4) != 0) {
+            ip++;
+            continue;
+        }
+        ref--;
+
+        size_t match_len = LZ_MIN_MATCH;
+        while (ip + match_len < in_len - 5 && in[ref + match_len] == in[ip + match_len]) {
+            match_len++;
+        }
+
+        size_t lit_len = ip - anchor;
+        size_t ml = match_len - LZ_MIN_MATCH;
+        unsigned char *token = op++;
+        *token = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+        if (lit_len >= 15) op = lz_put_length(op, lit_len - 15);
+        memcpy(op, in + anchor, lit_len);
+        op += lit_len;
+
+        size_t offset = ip - ref;
+        *op++ = (unsigned char)offset;
+        *op++ = (unsigned char)(offset >> 8);
+        if (ml >= 15) op = lz_put_length(op, ml - 15);
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    // Final literal run
+    size_t lit_len = in_len - anchor;
+    *op++ = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) op = lz_put_length(op, lit_len - 15);
+    memcpy(op, in + anchor, lit_len);
+    op += lit_len;
+
+    return (size_t)(op - out);
+}
+
+// Returns the decompressed size, or -1 if the input is malformed
+static long lz_decompress(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_cap) {
+    const unsigned char *ip = in, *end = in + in_len;
+    unsigned char *op = out, *out_end = out + out_cap;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return -1;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if ((size_t)(end - ip) < lit_len || (size_t)(out_end - op) < lit_len) return -1;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == end) break;  // The last sequence has no match
+
+        if (end - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) return -1;
+
+        size_t match_len = (token & 15);
+        if (match_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if ((size_t)(out_end - op) < match_len) return -1;
+
+        // Byte by byte, since the match may overlap the bytes it produces
+        const unsigned char *ref = op - offset;
+        for (size_t i = 0; i < match_len; i++) {
+            op[i] = ref[i];
+        }
+        op += match_len;
+    }
+
+    return (long)(op - out);
+}
+
+// Write data as a container: magic, flags, block count, a block index and
+// then the blocks. Blocks end on a line boundary so each holds whole records.
+static int write_container(FILE *fp, const char *data, size_t len, int encrypted) {
+    // Work out block boundaries first so the index can precede the data
+    int block_count = 0;
+    size_t *ends = NULL;
+    size_t start = 0;
+
+    while (start < len) {
+        size_t end = start + BLOCK_SIZE < len ? start + BLOCK_SIZE : len;
+        if (end < len) {
+            const char *nl = NULL;
+            for (size_t i = end; i > start; i--) {
+                if (data[i - 1] == '\n') {
+                    nl = data + i;
+                    break;
+                }
+            }
+            if (nl) end = (size_t)(nl - data);
+        }
+
+        size_t *grown = realloc(ends, (block_count + 1) * sizeof(size_t));
+        if (!grown) {
+            free(ends);
+            return 0;
+        }
+        ends = grown;
+        ends[block_count++] = end;
+        start = end;
+    }
+
+    BlockHeader *headers = calloc(block_count > 0 ? block_count : 1, sizeof(BlockHeader));
+    unsigned char *packed = malloc(lz_bound(BLOCK_SIZE) * (block_count > 0 ? block_count : 1));
+    if (!headers || !packed) {
+        free(ends);
+        free(headers);
+        free(packed);
+        return 0;
+    }
+
+    size_t packed_total = 0;
+    start = 0;
+    for (int b = 0; b < block_count; b++) {
+        size_t raw_len = ends[b] - start;
+        size_t n = lz_compress((const unsigned char *)data + start, raw_len,
+                               packed + packed_total, lz_bound(BLOCK_SIZE));
+        if (encrypted) {
+            xor_encrypt_decrypt((char *)packed + packed_total, ENCRYPTION_KEY, n);
+        }
+
+        uint32_t lines = 0;
+        for (size_t i = start; i < ends[b]; i++) {
+            if (data[i] == '\n') lines++;
+        }
+
+        headers[b].raw_size = (uint32_t)raw_len;
+        headers[b].packed_size = (uint32_t)n;
+        headers[b].line_count = lines;
+        packed_total += n;
+        start = ends[b];
+    }
+
+    unsigned char word[4];
+    fwrite(CONTAINER_MAGIC, 1, 4, fp);
+    put_u32(word, encrypted ? 1 : 0);
+    fwrite(word, 1, 4, fp);
+    put_u32(word, (uint32_t)block_count);
+    fwrite(word, 1, 4, fp);
+    for (int b = 0; b < block_count; b++) {
+        put_u32(word, headers[b].raw_size);
+        fwrite(word, 1, 4, fp);
+        put_u32(word, headers[b].packed_size);
+        fwrite(word, 1, 4, fp);
+        put_u32(word, headers[b].line_count);
+        fwrite(word, 1, 4, fp);
+    }
+    fwrite(packed, 1, packed_total, fp);
+
+    int ok = !ferror(fp);
+    free(ends);
+    free(headers);
+    free(packed);
+    return ok;
+}
+
+// Read a container (the magic has already been consumed) into one job per
+// block. The packed bytes of all blocks share jobs[0].packed.
+static BlockJob *read_container(FILE *fp, int *block_count) {
+    unsigned char word[12];
+    if (fread(word, 1, 8, fp) != 8) return NULL;
+
+    int encrypted = get_u32(word) & 1;
+    uint32_t count = get_u32(word + 4);
+    if (count > (1u << 20)) return NULL;
+
+    BlockJob *jobs = calloc(count > 0 ? count : 1, sizeof(BlockJob));
+    if (!jobs) return NULL;
+
+    size_t packed_total = 0;
+    for (uint32_t b = 0; b < count; b++) {
+        if (fread(word, 1, 12, fp) != 12) {
+            free(jobs);
+            return NULL;
+        }
+        jobs[b].header.raw_size = get_u32(word);
+        jobs[b].header.packed_size = get_u32(word + 4);
+        jobs[b].header.line_count = get_u32(word + 8);
+        jobs[b].encrypted = encrypted;
+        jobs[b].segment = -1;
+        // Every line ends with '\n', so a block cannot hold more lines than bytes
+        if (jobs[b].header.raw_size > BLOCK_SIZE ||
+            jobs[b].header.packed_size > lz_bound(BLOCK_SIZE) ||
+            jobs[b].header.line_count > jobs[b].header.raw_size) {
+            free(jobs);
+            return NULL;
+        }
+        packed_total += jobs[b].header.packed_size;
+    }
+
+    unsigned char *packed = malloc(packed_total > 0 ? packed_total : 1);
+    if (!packed || fread(packed, 1, packed_total, fp) != packed_total) {
+        free(packed);
+        free(jobs);
+        return NULL;
+    }
+
+    size_t offset = 0;
+    for (uint32_t b = 0; b < count; b++) {
+        jobs[b].packed = packed + offset;
+        offset += jobs[b].header.packed_size;
+    }
+    if (count == 0) free(packed);
+
+    *block_count = (int)count;
+    return jobs;
+}
+
+// Decode one block; a ParallelTask on BlockJob items
+static void decode_block(void *arg) {
+    BlockJob *job = arg;
+    job->ok = 0;
+    job->parsed = 0;
+    job->raw = malloc(job->header.raw_size + 1);
+    if (!job->raw) return;
+
+    if (job->encrypted) {
+        xor_encrypt_decrypt((char *)job->packed, ENCRYPTION_KEY, job->header.packed_size);
+    }
+
+    long n = lz_decompress(job->packed, job->header.packed_size,
+                           (unsigned char *)job->raw, job->header.raw_size);
+    if (n != (long)job->header.raw_size) return;
+    job->raw[n] = '\0';
+
+    if (job->events) {
+        char *line = job->raw;
+        char *end = job->raw + n;
+        while (line < end && job->parsed < (int)job->header.line_count) {
+            char *nl = memchr(line, '\n', (size_t)(end - line));
+            if (!nl) break;
+            *nl = '\0';
+
+            PlannerEvent *e = &job->events[job->parsed];
+            if (parse_record(line, e) &&
+                (job->segment < 0 || segment_index(e->year, e->month) == job->segment)) {
+                job->parsed++;
+            }
+            line = nl + 1;
+        }
+    }
+    job->ok = 1;
+}
+
+static void free_container(BlockJob *jobs, int block_count) {
+    if (!jobs) return;
+    for (int b = 0; b < block_count; b++) {
+        free(jobs[b].raw);
+    }
+    if (block_count > 0) free(jobs[0].packed);
+    free(jobs);
+}
+
+// Decode a container into events appended to out, parsing blocks in
+// parallel, each into its own slice, then packing the slices together.
+// segment limits records to one month (-1 = any). Returns the number of
+// events read and sets count to the number of records stored, or -1.
+static int read_container_events(FILE *fp, int segment, EventList *out, int *count, int *corrupt) {
+    int block_count = 0;
+    BlockJob *jobs = read_container(fp, &block_count);
+    if (!jobs) return -1;
+
+    *count = 0;
+    *corrupt = 0;
+    for (int b = 0; b < block_count; b++) {
+        // Reject totals that would overflow the slot arithmetic below
+        if (jobs[b].header.line_count > (uint32_t)(INT_MAX - out->count - *count)) {
+            free_container(jobs, block_count);
+            return -1;
+        }
+        *count += (int)jobs[b].header.line_count;
+    }
+    if (!list_reserve(out, *count)) {
+        free_container(jobs, block_count);
+        return -1;
+    }
+
+    int slot = out->count;
+    for (int b = 0; b < block_count; b++) {
+        jobs[b].events = &out->events[slot];
+        jobs[b].segment = segment;
+        slot += (int)jobs[b].header.line_count;
+    }
+
+    run_parallel(decode_block, jobs, sizeof(BlockJob), block_count);
+
+    int loaded = 0;
+    for (int b = 0; b < block_count; b++) {
+        if (!jobs[b].ok) {
+            (*corrupt)++;
+            continue;
+        }
+        PlannerEvent *dst = &out->events[out->count + loaded];
+        if (dst != jobs[b].events) {
+            memmove(dst, jobs[b].events, (size_t)jobs[b].parsed * sizeof(PlannerEvent));
+        }
+        loaded += jobs[b].parsed;
+    }
+    out->count += loaded;
+
+    free_container(jobs, block_count);
+    return loaded;
+}
+
+int planner_write_compressed_file(const char *path, const char *data, size_t len) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return 0;
+
+    int ok = write_container(fp, data, len, 0);
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+int planner_read_compressed_file(const char *path, char **data, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    char magic[4];
+    int block_count = 0;
+    BlockJob *jobs = NULL;
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, CONTAINER_MAGIC, 4) != 0 ||
+        !(jobs = read_container(fp, &block_count))) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    run_parallel(decode_block, jobs, sizeof(BlockJob), block_count);
+
+    size_t total = 0;
+    for (int b = 0; b < block_count; b++) {
+        total += jobs[b].header.raw_size;
+    }
+
+    char *text = malloc(total + 1);
+    int ok = text != NULL;
+    size_t offset = 0;
+    for (int b = 0; ok && b < block_count; b++) {
+        if (!jobs[b].ok) {
+            ok = 0;
+            break;
+        }
+        memcpy(text + offset, jobs[b].raw, jobs[b].header.raw_size);
+        offset += jobs[b].header.raw_size;
+    }
+    free_container(jobs, block_count);
+
+    if (!ok) {
+        free(text);
+        return 0;
+    }
+    text[offset] = '\0';
+    *data = text;
+    *len = offset;
+    return 1;
+}
+
+// ---- Segment files ----
+
+// Plain segment: a count line, then length-prefixed encrypted records.
+// Returns the number of events appended, or -1 on error.
+static int load_text_segment(Planner *p, FILE *fp, int index, const char *path,
+                             EventList *out, int *count) {
+    if (fscanf(fp, "%d", count) != 1 || fgetc(fp) != '\n' || *count < 0) {
+        set_message(p, "Error reading segment %s.", path);
+        return -1;
+    }
+
+    if (!list_reserve(out, *count)) {
+        set_message(p, "Error: Not enough memory to load %s.", path);
+        return -1;
+    }
+
+    // Records are length-prefixed, so encrypted bytes may contain anything
+    char buffer[RECORD_SIZE];
+    int loaded = 0;
+    for (int i = 0; i < *count; i++) {
+        int len;
+        if (fscanf(fp, "%d", &len) != 1 || fgetc(fp) != ' ' ||
+            len <= 0 || len >= RECORD_SIZE ||
+            fread(buffer, 1, (size_t)len, fp) != (size_t)len) {
+            set_message(p, "Warning: Segment %s is truncated.", path);
+            break;
+        }
+        buffer[len] = '\0';
+        xor_encrypt_decrypt(buffer, ENCRYPTION_KEY, (size_t)len);
+
+        PlannerEvent *e = &out->events[out->count];
+        if (parse_record(buffer, e) && segment_index(e->year, e->month) == index) {
+            out->count++;
+            loaded++;
+        } else {
+            set_message(p, "Warning: Skipped invalid event record in %s.", path);
+        }
+    }
+    return loaded;
+}
+
+// Read a segment file of either format, appending to out. Returns the
+// number of events read and sets count to the number the file claims, or -1.
+static int read_segment_file(Planner *p, const char *path, int index, EventList *out, int *count) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        set_message(p, "Error: Segment file %s is missing.", path);
+        return -1;
+    }
+
+    // Compressed containers start with a magic; plain segments with a count
+    char magic[4];
+    int loaded;
+    *count = 0;
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, CONTAINER_MAGIC, 4) == 0) {
+        int corrupt;
+        loaded = read_container_events(fp, index, out, count, &corrupt);
+        if (loaded < 0) {
+            set_message(p, "Error reading segment %s.", path);
+        } else if (corrupt) {
+            set_message(p, "Warning: %d blocks of segment %s are corrupt.", corrupt, path);
+        } else if (loaded < *count) {
+            set_message(p, "Warning: Skipped invalid event record in %s.", path);
+        }
+    } else {
+        rewind(fp);
+        loaded = load_text_segment(p, fp, index, path, out, count);
+    }
+
+    fclose(fp);
+    return loaded;
+}
+
+// Gather a segment's records as plain text and write them as a container;
+// compression runs before encryption so the records still compress well
+static int save_compressed_segment(FILE *fp, int index, const PlannerEvent *events, int event_count,
+                                   int in_segment) {
+    char *text = malloc((size_t)in_segment * RECORD_SIZE + 1);
+    if (!text) return 0;
+
+    size_t len = 0;
+    for (int i = 0; i < event_count; i++) {
+        const PlannerEvent *e = &events[i];
+        if (segment_index(e->year, e->month) != index) continue;
+
+        int n = format_record(text + len, RECORD_SIZE, e);
+        if (n > 0) len += (size_t)n;
+    }
+
+    int ok = write_container(fp, text, len, 1);
+    free(text);
+    return ok;
+}
+
+// Write the events that belong to one segment (or remove the file when
+// there are none). Returns the number written, or -1 on error, and the
+// segment's digest through digest.
+static int write_segment_file(Planner *p, const char *path, int index, const PlannerEvent *events,
+                              int event_count, int compress, uint64_t *digest) {
+    int in_segment = 0;
+    *digest = 0;
+    for (int i = 0; i < event_count; i++) {
+        if (segment_index(events[i].year, events[i].month) == index) {
+            *digest = digest_add(*digest, event_hash(&events[i]));
+            in_segment++;
+        }
+    }
+
+    if (in_segment == 0) {
+        remove(path);
+        return 0;
+    }
+
+    // Written to a temporary file and renamed, so a reader never sees half a segment
+    char temp_path[PATH_SIZE + 4];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *fp = fopen(temp_path, "wb");
+    if (!fp) {
+        set_message(p, "Error opening %s for writing.", path);
+        return -1;
+    }
+
+    if (compress) {
+        int ok = save_compressed_segment(fp, index, events, event_count, in_segment);
+        if (fclose(fp) != 0 || rename(temp_path, path) != 0) ok = 0;
+        if (!ok) {
+            set_message(p, "Error writing %s.", path);
+            remove(temp_path);
+            return -1;
+        }
+        return in_segment;
+    }
+
+    fprintf(fp, "%d\n", in_segment);
+
+    char buffer[RECORD_SIZE];
+    for (int i = 0; i < event_count; i++) {
+        const PlannerEvent *e = &events[i];
+        if (segment_index(e->year, e->month) != index) continue;
+
+        int len = format_record(buffer, sizeof(buffer), e);
+        if (len < 0) continue;
+
+        xor_encrypt_decrypt(buffer, ENCRYPTION_KEY, (size_t)len);
+        fprintf(fp, "%d ", len);
+        fwrite(buffer, sizeof(char), (size_t)len, fp);
+    }
+
+    if (fclose(fp) != 0 || rename(temp_path, path) != 0) {
+        set_message(p, "Error writing %s.", path);
+        remove(temp_path);
+        return -1;
+    }
+    return in_segment;
+}
+
+// Read one segment file and append its events to the resident list
+static int load_segment(Planner *p, int index) {
+    Segment *seg = &p->segments[index];
+    if (seg->loaded) return 1;
+
+    if (!seg->on_disk) {
+        seg->loaded = 1;
+        return 1;
+    }
+
+    char path[PATH_SIZE];
+    segment_path(path, sizeof(path), p->dir, index);
+
+    int count;
+    lock_schedule(p, LOCK_SH);
+    int loaded = read_segment_file(p, path, index, &p->schedule, &count);
+    unlock_schedule(p);
+    if (loaded < 0) return 0;
+
+    seg->event_count = loaded;
+    seg->loaded = 1;
+    seg->dirty = (loaded != count);
+    return 1;
+}
+
+// Write one loaded segment back to its file
+static int save_segment(Planner *p, int index) {
+    Segment *seg = &p->segments[index];
+    char path[PATH_SIZE];
+    segment_path(path, sizeof(path), p->dir, index);
+
+    int written = write_segment_file(p, path, index, p->schedule.events, p->schedule.count,
+                                     p->compress, &seg->digest);
+    if (written < 0) return 0;
+
+    seg->event_count = written;
+    seg->on_disk = written > 0;
+    seg->dirty = 0;
+    free_segment_base(seg);
+    return 1;
+}
+
+// Drop a saved segment's events from memory
+static void evict_segment(Planner *p, int index) {
+    Segment *seg = &p->segments[index];
+    // Unsaved edits are only written by an explicit save
+    if (!seg->loaded || seg->dirty) return;
+
+    int kept = 0;
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (segment_index(e->year, e->month) != index) {
+            if (kept != i) p->schedule.events[kept] = *e;
+            kept++;
+        }
+    }
+    p->schedule.count = kept;
+    seg->loaded = 0;
+    free_segment_base(seg);
+}
+
+static int resident_segment_count(const Planner *p) {
+    int resident = 0;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].loaded && p->segments[i].event_count > 0) resident++;
+    }
+    return resident;
+}
+
+// Load every wanted segment, then evict the least recently used segments
+// that are not wanted until we are under the cap. The wanted ones count
+// against the cap but are never evicted, nor are unsaved ones.
+static int ensure_segment_set_loaded(Planner *p, const unsigned char *wanted) {
+    unsigned long now = ++p->segment_clock;
+
+    int ok = 1;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (!wanted[i]) continue;
+        p->segments[i].last_used = now;
+        if (!load_segment(p, i)) ok = 0;
+    }
+
+    int resident = resident_segment_count(p);
+    while (resident > MAX_RESIDENT_SEGMENTS) {
+        int oldest = -1;
+        for (int i = 0; i < MAX_SEGMENTS; i++) {
+            const Segment *seg = &p->segments[i];
+            if (seg->loaded && !seg->dirty && seg->event_count > 0 && seg->last_used < now &&
+                (oldest < 0 || seg->last_used < p->segments[oldest].last_used)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) break;
+        evict_segment(p, oldest);
+        resident--;
+    }
+    return ok;
+}
+
+static int ensure_segments_loaded(Planner *p, int first_index, int last_index) {
+    unsigned char wanted[MAX_SEGMENTS] = {0};
+    for (int i = first_index; i <= last_index; i++) {
+        wanted[i] = 1;
+    }
+    return ensure_segment_set_loaded(p, wanted);
+}
+
+// Whole-history operations need every segment; the LRU cap is applied
+// again by the next ranged query
+int planner_load_all(Planner *p) {
+    unsigned long now = ++p->segment_clock;
+    int ok = 1;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].on_disk && !p->segments[i].loaded) {
+            if (!load_segment(p, i)) ok = 0;
+        }
+        if (p->segments[i].loaded) p->segments[i].last_used = now;
+    }
+    return ok;
+}
+
+static void free_segment_base(Segment *seg) {
+    free(seg->base_ids);
+    free(seg->base_hashes);
+    seg->base_ids = NULL;
+    seg->base_hashes = NULL;
+    seg->base_count = 0;
+    seg->has_base = 0;
+}
+
+// Remember the hashes of a clean segment's events, i.e. what is on disk, so
+// changes saved by another process can later be merged against them
+static void snapshot_segment_base(Planner *p, int index) {
+    Segment *seg = &p->segments[index];
+    if (seg->has_base || seg->dirty || !seg->loaded) return;
+
+    int count = 0;
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (segment_index(e->year, e->month) == index) count++;
+    }
+
+    seg->base_ids = malloc((size_t)(count > 0 ? count : 1) * sizeof(int64_t));
+    seg->base_hashes = malloc((size_t)(count > 0 ? count : 1) * sizeof(uint64_t));
+    if (!seg->base_ids || !seg->base_hashes) {
+        free_segment_base(seg);
+        return;
+    }
+
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (segment_index(e->year, e->month) != index) continue;
+        seg->base_ids[seg->base_count] = e->id;
+        seg->base_hashes[seg->base_count] = event_hash(e);
+        seg->base_count++;
+    }
+    seg->has_base = 1;
+}
+
+// Record that an event in this month is about to be added, changed or
+// removed. Must be called before the resident events change.
+static void mark_segment_dirty(Planner *p, int index) {
+    snapshot_segment_base(p, index);
+    p->segments[index].loaded = 1;
+    p->segments[index].dirty = 1;
+    p->generation++;
+}
+
+// ---- Manifest ----
+
+// Manifest: a header line "segments next_id compress node generation", then
+// one "YYYY MM count digest" line per segment file
+static int write_manifest_file(Planner *p, const char *dir, const Manifest *m) {
+    char path[PATH_SIZE], temp_path[PATH_SIZE + 4];
+    manifest_path(path, sizeof(path), dir);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(temp_path, "w");
+    if (!fp) {
+        set_message(p, "Error opening %s for writing.", path);
+        return 0;
+    }
+
+    int segment_count = 0;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (m->on_disk[i]) segment_count++;
+    }
+
+    fprintf(fp, "%d %" PRId64 " %d %d %lu\n", segment_count, m->next_id, m->compress, m->node_id,
+            m->generation);
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (m->on_disk[i]) {
+            fprintf(fp, "%d %d %d %016llx\n", FIRST_YEAR + i / 12, i % 12 + 1,
+                    m->event_count[i], (unsigned long long)m->digest[i]);
+        }
+    }
+
+    if (fclose(fp) != 0 || rename(temp_path, path) != 0) {
+        set_message(p, "Error writing %s.", path);
+        remove(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Older manifests lack the compression flag, node ID, generation and
+// digests; missing digests read as 0 (unknown)
+static int read_manifest_file(Planner *p, const char *dir, Manifest *m) {
+    char path[PATH_SIZE];
+    manifest_path(path, sizeof(path), dir);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    memset(m, 0, sizeof(*m));
+
+    char line[128];
+    int segment_count;
+    if (!fgets(line, sizeof(line), fp) ||
+        sscanf(line, "%d %" SCNd64 " %d %d %lu", &segment_count, &m->next_id,
+               &m->compress, &m->node_id, &m->generation) < 2) {
+        set_message(p, "Error reading schedule manifest %s.", path);
+        fclose(fp);
+        return 0;
+    }
+
+    for (int i = 0; i < segment_count; i++) {
+        int year, month, count;
+        unsigned long long digest = 0;
+        if (!fgets(line, sizeof(line), fp) ||
+            sscanf(line, "%d %d %d %llx", &year, &month, &count, &digest) < 3) {
+            set_message(p, "Warning: Schedule manifest %s is truncated.", path);
+            break;
+        }
+        if (year < FIRST_YEAR || year > LAST_YEAR || month < 1 || month > 12) {
+            continue;
+        }
+
+        int index = segment_index(year, month);
+        m->on_disk[index] = 1;
+        m->event_count[index] = count;
+        m->digest[index] = digest;
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+static int save_manifest(Planner *p) {
+    Manifest *m = malloc(sizeof(Manifest));
+    if (!m) return 0;
+
+    m->next_id = p->next_id;
+    m->compress = p->compress;
+    m->node_id = p->node_id;
+    m->generation = p->disk_generation;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        m->on_disk[i] = (unsigned char)p->segments[i].on_disk;
+        m->event_count[i] = p->segments[i].event_count;
+        m->digest[i] = p->segments[i].digest;
+    }
+
+    int ok = write_manifest_file(p, p->dir, m);
+    free(m);
+    return ok;
+}
+
+static int load_manifest(Planner *p) {
+    Manifest *m = malloc(sizeof(Manifest));
+    if (!m) return 0;
+
+    if (!read_manifest_file(p, p->dir, m)) {
+        free(m);
+        return 0;
+    }
+
+    p->next_id = m->next_id;
+    p->compress = m->compress;
+    p->node_id = m->node_id;
+    p->disk_generation = m->generation;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        p->segments[i].on_disk = m->on_disk[i];
+        p->segments[i].event_count = m->event_count[i];
+        p->segments[i].digest = m->digest[i];
+    }
+
+    free(m);
+    return 1;
+}
+
+// ---- Opening and saving ----
+
+// Read the old single-file schedule.dat so it can be split into segments.
+// Each record was XORed separately with the key restarting at its first
+// byte, so records are recovered by decrypting byte by byte and resetting
+// the key position after every decrypted newline.
+static int load_legacy_schedule(Planner *p) {
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", p->dir, LEGACY_SCHEDULE_FILE);
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    // First read the event count and next ID
+    char header[64];
+    int expected, next_id;
+    if (!fgets(header, sizeof(header), fp) ||
+        sscanf(header, "%d %d", &expected, &next_id) != 2 || expected < 0) {
+        set_message(p, "Error reading schedule metadata.");
+        fclose(fp);
+        return 0;
+    }
+    p->next_id = next_id;
+
+    if (!list_reserve(&p->schedule, expected)) {
+        set_message(p, "Error: Not enough memory to load %s.", path);
+        fclose(fp);
+        return 0;
+    }
+
+    char buffer[RECORD_SIZE];
+    size_t len = 0;
+    size_t key_len = strnlen(ENCRYPTION_KEY, KEY_SIZE);
+    int read = 0, skipped = 0;
+    int c;
+
+    while (read < expected && (c = fgetc(fp)) != EOF) {
+        char plain = (char)(c ^ ENCRYPTION_KEY[len % key_len]);
+        if (len < sizeof(buffer) - 1) {
+            buffer[len] = plain;
+        }
+        len++;
+        if (plain != '\n') continue;
+
+        buffer[len < sizeof(buffer) ? len : sizeof(buffer) - 1] = '\0';
+        len = 0;
+        read++;
+
+        PlannerEvent *e = &p->schedule.events[p->schedule.count];
+        if (parse_record(buffer, e)) {
+            int index = segment_index(e->year, e->month);
+            p->segments[index].event_count++;
+            mark_segment_dirty(p, index);
+            p->schedule.count++;
+        } else {
+            skipped++;
+        }
+    }
+
+    fclose(fp);
+    set_message(p, "Converted %s to monthly segments. %d events found%s.",
+                LEGACY_SCHEDULE_FILE, p->schedule.count,
+                skipped ? " (some invalid records were skipped)" : "");
+    return 1;
+}
+
+// Pick a random node ID for a copy that does not have one yet. The kernel's
+// random source is preferred; the clock and process ID are the fallback.
+static void assign_node_id(Planner *p) {
+    uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 20) ^ (uint64_t)(uintptr_t)p;
+    uint64_t random = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (read(fd, &random, sizeof(random)) == (ssize_t)sizeof(random)) seed ^= random;
+        close(fd);
+    }
+    seed = digest_add(0, seed);
+    p->node_id = 1 + (int)(seed % MAX_NODE_ID);
+}
+
+// A copied directory inherits the manifest and with it the node ID, so the
+// copies would issue the same event IDs. The node file records which
+// directory the node ID was issued to; a copy has another device or inode,
+// and is given a new node ID before it can add anything. Existing events
+// keep their IDs, as both copies hold the same ones.
+static void check_node_owner(Planner *p, int have_manifest) {
+    struct stat st;
+    if (stat(p->dir, &st) != 0) return;
+
+    char path[PATH_SIZE], temp_path[PATH_SIZE + 4];
+    snprintf(path, sizeof(path), "%s/%s", p->dir, NODE_FILE);
+    unsigned long long device = 0, inode = 0;
+    FILE *fp = fopen(path, "r");
+    int recorded = fp && fscanf(fp, "%llu %llu", &device, &inode) == 2;
+    if (fp) fclose(fp);
+    if (recorded && device == (unsigned long long)st.st_dev &&
+        inode == (unsigned long long)st.st_ino) {
+        return;
+    }
+
+    if (recorded && have_manifest) {
+        int old_node = p->node_id;
+        int64_t old_next = p->next_id;
+        assign_node_id(p);
+        if (p->node_id == old_node) p->node_id = old_node % MAX_NODE_ID + 1;
+        p->next_id = 1;
+        if (!save_manifest(p)) {
+            // Keep the old ID and file, so the next open tries again
+            p->node_id = old_node;
+            p->next_id = old_next;
+            return;
+        }
+        set_message(p, "This schedule was copied from another directory; it now uses node ID %d.",
+                    p->node_id);
+    }
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    fp = fopen(temp_path, "w");
+    if (!fp) return;
+    fprintf(fp, "%llu %llu\n", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    if (fclose(fp) != 0 || rename(temp_path, path) != 0) remove(temp_path);
+}
+
+Planner *planner_open(const char *dir) {
+    Planner *p = calloc(1, sizeof(Planner));
+    if (!p) return NULL;
+
+    snprintf(p->dir, sizeof(p->dir), "%s", dir && dir[0] ? dir : ".");
+    p->next_id = 1;
+    p->generation = 1;
+
+    // Several processes may share the directory: saves take an exclusive
+    // lock, and the watcher tells us when another process saved
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", p->dir, LOCK_FILE);
+    p->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    p->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (p->watch_fd >= 0 &&
+        inotify_add_watch(p->watch_fd, p->dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+        close(p->watch_fd);
+        p->watch_fd = -1;
+    }
+
+    // Exclusive, as a copied directory gets its own node ID here
+    lock_schedule(p, LOCK_EX);
+    int have_manifest = load_manifest(p);
+    if (p->node_id == 0) {
+        assign_node_id(p);
+    }
+    check_node_owner(p, have_manifest);
+    unlock_schedule(p);
+
+    if (!have_manifest) {
+        if (load_legacy_schedule(p)) {
+            planner_save(p);
+        } else if (!p->message[0]) {
+            set_message(p, NO_SCHEDULE_MESSAGE);
+        }
+        return p;
+    }
+
+    // Only the current month is loaded up front; other months load on demand
+    // localtime_r, as handles may be used on different threads
+    time_t now = time(NULL);
+    struct tm t;
+    localtime_r(&now, &t);
+    int index = segment_index(t.tm_year + 1900, t.tm_mon + 1);
+    ensure_segments_loaded(p, index, index);
+    return p;
+}
+
+void planner_close(Planner *p) {
+    if (!p) return;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        free_segment_base(&p->segments[i]);
+    }
+    if (p->lock_fd >= 0) close(p->lock_fd);
+    if (p->watch_fd >= 0) close(p->watch_fd);
+    free_fuzzy_index(p->fuzzy);
+    free(p->schedule.events);
+    free(p);
+}
+
+// Write every changed segment, then the manifest
+int planner_save(Planner *p) {
+    return save_changes(p, -1);
+}
+
+// Switch the storage format; every segment is rewritten on the next save
+void planner_set_compression(Planner *p, int enabled) {
+    if (p->compress == !!enabled) return;
+
+    planner_load_all(p);
+    p->compress = !!enabled;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].on_disk) mark_segment_dirty(p, i);
+    }
+}
+
+// ---- Locking and live reload ----
+
+// Advisory lock on the directory's lock file. Nested calls only count, so
+// the outermost caller must take the strongest lock it needs.
+static void lock_schedule(Planner *p, int operation) {
+    if (p->lock_depth++ == 0 && p->lock_fd >= 0) {
+        while (flock(p->lock_fd, operation) < 0 && errno == EINTR);
+    }
+}
+
+static void unlock_schedule(Planner *p) {
+    if (--p->lock_depth == 0 && p->lock_fd >= 0) {
+        flock(p->lock_fd, LOCK_UN);
+    }
+}
+
+// Take up the IDs another process sharing the directory saved: a later
+// sequence number, or a new node ID after a sync split the node
+static void adopt_manifest_ids(Planner *p, const Manifest *m) {
+    if (m->node_id != 0 && m->node_id != p->node_id) {
+        p->node_id = m->node_id;
+        p->next_id = m->next_id;
+    } else if (m->next_id > p->next_id) {
+        p->next_id = m->next_id;
+    }
+}
+
+// Reserve count sequence numbers. Processes sharing the directory share the
+// node ID, so the counter is advanced in the manifest under the lock.
+// Returns the first one, or -1 if they would run past this node's range.
+static int64_t reserve_event_ids(Planner *p, int count) {
+    lock_schedule(p, LOCK_EX);
+
+    Manifest *m = malloc(sizeof(Manifest));
+    int have_manifest = m && read_manifest_file(p, p->dir, m);
+    if (have_manifest) adopt_manifest_ids(p, m);
+
+    int64_t first = p->next_id;
+    if (count > ID_SEQUENCE_LIMIT - first) {
+        set_message(p, "No event IDs left for node %d; nothing was added.", p->node_id);
+        free(m);
+        unlock_schedule(p);
+        return -1;
+    }
+    p->next_id += count;
+    if (have_manifest) {
+        m->next_id = p->next_id;
+        write_manifest_file(p, p->dir, m);
+    }
+
+    free(m);
+    unlock_schedule(p);
+    return first;
+}
+
+// Merge what another process saved since we last read or wrote the
+// manifest. Only partitions whose digest changed are read, and within them
+// events are merged by ID and hash against the saved state each dirty
+// segment started from, the same three-way merge sync uses. Partitions that
+// are not resident just take the new manifest entry. The caller holds the
+// lock. Returns 1 if anything changed, or -1 if the changes could not be
+// read or merged (the message says why); a save must then stop, as it
+// would overwrite them.
+static int reload_changes(Planner *p, PlannerSyncReport *report,
+                          PlannerConflictCallback on_conflict, void *ctx) {
+    memset(report, 0, sizeof(*report));
+
+    Manifest *m = malloc(sizeof(Manifest));
+    unsigned char *differs = calloc(MAX_SEGMENTS, 1);
+    unsigned char *was_dirty = calloc(MAX_SEGMENTS, 1);
+    if (!m || !differs || !was_dirty || !read_manifest_file(p, p->dir, m) ||
+        m->generation == p->disk_generation) {
+        free(m);
+        free(differs);
+        free(was_dirty);
+        return 0;
+    }
+
+    adopt_manifest_ids(p, m);
+
+    EventList theirs = {0};
+    SyncBase base;
+    memset(&base, 0, sizeof(base));
+    int merge_count = 0;
+    int ok = 1;
+
+    for (int i = 0; ok && i < MAX_SEGMENTS; i++) {
+        Segment *seg = &p->segments[i];
+        uint64_t known = seg->on_disk ? seg->digest : 0;
+        uint64_t current = m->on_disk[i] ? m->digest[i] : 0;
+        if (seg->on_disk || m->on_disk[i]) report->partitions_compared++;
+        if (known == current) continue;
+        report->partitions_differed++;
+
+        if (!seg->loaded) {
+            seg->on_disk = m->on_disk[i];
+            seg->event_count = m->event_count[i];
+            seg->digest = m->digest[i];
+            p->generation++;  // Its events changed, though none are resident
+            continue;
+        }
+
+        if (m->on_disk[i]) {
+            char path[PATH_SIZE];
+            int claimed;
+            segment_path(path, sizeof(path), p->dir, i);
+            if (read_segment_file(p, path, i, &theirs, &claimed) < 0) {
+                set_message(p, "Could not read %s, saved by another process.", path);
+                ok = 0;
+                break;
+            }
+        }
+        differs[i] = 1;
+        was_dirty[i] = (unsigned char)seg->dirty;
+        merge_count++;
+
+        // A clean segment is its own base; a dirty one uses its snapshot
+        if (seg->dirty) {
+            for (int k = 0; ok && k < seg->base_count; k++) {
+                ok = sync_base_add(&base, seg->base_ids[k], i, seg->base_hashes[k]);
+            }
+        } else {
+            for (int k = 0; ok && k < p->schedule.count; k++) {
+                const PlannerEvent *e = &p->schedule.events[k];
+                if (segment_index(e->year, e->month) == i) {
+                    ok = sync_base_add(&base, e->id, i, event_hash(e));
+                }
+            }
+        }
+        if (!ok) set_message(p, "Not enough memory to merge the changes.");
+    }
+
+    if (ok && merge_count > 0) {
+        ok = merge_partitions(p, differs, &theirs, &base, report, on_conflict, ctx);
+    }
+    if (!ok) {
+        // Nothing was merged; the resident months keep their old saved state
+        // and the manifest generation is not taken, so the next reload or
+        // save tries again
+        free(theirs.events);
+        free_sync_base(&base);
+        free(m);
+        free(differs);
+        free(was_dirty);
+        return -1;
+    }
+
+    // The new files are now the saved state. Clean segments match them
+    // exactly; dirty ones keep their local changes against the new base.
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (!differs[i]) continue;
+        Segment *seg = &p->segments[i];
+        seg->on_disk = m->on_disk[i];
+        seg->digest = m->digest[i];
+        free_segment_base(seg);
+        if (!was_dirty[i]) {
+            seg->dirty = 0;
+            continue;
+        }
+
+        int count = 0;
+        for (int k = 0; k < theirs.count; k++) {
+            if (segment_index(theirs.events[k].year, theirs.events[k].month) == i) count++;
+        }
+        seg->base_ids = malloc((size_t)(count > 0 ? count : 1) * sizeof(int64_t));
+        seg->base_hashes = malloc((size_t)(count > 0 ? count : 1) * sizeof(uint64_t));
+        if (!seg->base_ids || !seg->base_hashes) {
+            free_segment_base(seg);
+            continue;
+        }
+        for (int k = 0; k < theirs.count; k++) {
+            const PlannerEvent *e = &theirs.events[k];
+            if (segment_index(e->year, e->month) != i) continue;
+            seg->base_ids[seg->base_count] = e->id;
+            seg->base_hashes[seg->base_count] = event_hash(e);
+            seg->base_count++;
+        }
+        seg->has_base = 1;
+    }
+
+    p->disk_generation = m->generation;
+    free(theirs.events);
+    free_sync_base(&base);
+    free(m);
+    free(differs);
+    free(was_dirty);
+    return report->partitions_differed > 0;
+}
+
+// Save changed segments (all of them, or only only_index) and the manifest
+// under an exclusive lock, first merging anything another process saved so
+// it is not overwritten
+static int save_changes(Planner *p, int only_index) {
+    lock_schedule(p, LOCK_EX);
+
+    // Saving without the other process's changes would overwrite them
+    PlannerSyncReport merged;
+    if (reload_changes(p, &merged, NULL, NULL) < 0) {
+        unlock_schedule(p);
+        return 0;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (only_index >= 0 && i != only_index) continue;
+        if (p->segments[i].loaded && p->segments[i].dirty) {
+            if (!save_segment(p, i)) ok = 0;
+        }
+    }
+
+    p->disk_generation++;
+    ok = save_manifest(p) && ok;
+    unlock_schedule(p);
+
+    if (ok && merged.added_here + merged.updated_here + merged.deleted_here + merged.conflicts > 0) {
+        set_message(p, "Merged changes saved by another process: %d added, %d updated, %d deleted"
+                    " (%d conflicts kept this copy's version).", merged.added_here,
+                    merged.updated_here, merged.deleted_here, merged.conflicts);
+    }
+    return ok;
+}
+
+int planner_watch_fd(const Planner *p) {
+    return p->watch_fd;
+}
+
+int planner_reload(Planner *p, PlannerSyncReport *report,
+                   PlannerConflictCallback on_conflict, void *ctx) {
+    memset(report, 0, sizeof(*report));
+
+    // Without pending notifications nothing was written; without a watcher
+    // fall back to reading the manifest every time
+    if (p->watch_fd >= 0) {
+        char events[4096];
+        int pending = 0;
+        while (read(p->watch_fd, events, sizeof(events)) > 0) pending = 1;
+        if (!pending) return 0;
+    }
+
+    lock_schedule(p, LOCK_SH);
+    int changed = reload_changes(p, report, on_conflict, ctx);
+    unlock_schedule(p);
+    return changed > 0;
+}
+
+// ---- Batch operations ----
+
+// Append events whose months are already resident, keeping their IDs
+static void append_events(Planner *p, const PlannerEvent *events, int count) {
+    for (int i = 0; i < count; i++) {
+        int index = segment_index(events[i].year, events[i].month);
+        mark_segment_dirty(p, index);
+        p->schedule.events[p->schedule.count++] = events[i];
+        p->segments[index].event_count++;
+    }
+}
+
+int planner_add_many(Planner *p, PlannerEvent *events, int count) {
+    if (count <= 0) return 0;
+
+    // Validate everything before touching the schedule
+    unsigned char wanted[MAX_SEGMENTS] = {0};
+    for (int i = 0; i < count; i++) {
+        if (!planner_validate_event(&events[i])) {
+            set_message(p, "Event %d of the batch is invalid; nothing was added.", i + 1);
+            return 0;
+        }
+        wanted[segment_index(events[i].year, events[i].month)] = 1;
+    }
+
+    // One load pass for all months touched, and one allocation
+    if (!ensure_segment_set_loaded(p, wanted) || !list_reserve(&p->schedule, count)) {
+        set_message(p, "Could not add events: their months could not be loaded.");
+        return 0;
+    }
+
+    // IDs are in this node's range
+    int64_t first = reserve_event_ids(p, count);
+    if (first < 0) return 0;
+    for (int i = 0; i < count; i++) {
+        events[i].id = ((int64_t)p->node_id << ID_NODE_SHIFT) + first + i;
+    }
+    append_events(p, events, count);
+    return count;
+}
+
+int planner_delete_many(Planner *p, const int64_t *ids, int count) {
+    if (count <= 0) return 0;
+
+    // IDs do not say which month an event is in, so every month is needed
+    planner_load_all(p);
+
+    IdTable doomed;
+    if (!id_table_init(&doomed, count)) return 0;
+    for (int i = 0; i < count; i++) {
+        if (ids[i] > 0) id_table_put(&doomed, ids[i], 1);
+    }
+
+    // Mark the affected months first, while their events are still intact
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (id_table_get(&doomed, e->id) >= 0) {
+            mark_segment_dirty(p, segment_index(e->year, e->month));
+        }
+    }
+
+    int kept = 0, deleted = 0;
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (id_table_get(&doomed, e->id) >= 0) {
+            p->segments[segment_index(e->year, e->month)].event_count--;
+            deleted++;
+            continue;
+        }
+        if (kept != i) p->schedule.events[kept] = *e;
+        kept++;
+    }
+    p->schedule.count = kept;
+
+    id_table_free(&doomed);
+    return deleted;
+}
+
+// Index of the resident event with this ID, or -1
+static int find_event(Planner *p, int64_t id) {
+    for (int i = 0; i < p->schedule.count; i++) {
+        if (p->schedule.events[i].id == id) return i;
+    }
+    return -1;
+}
+
+int planner_update(Planner *p, const PlannerEvent *e) {
+    if (!planner_validate_event(e)) {
+        set_message(p, "Invalid event.");
+        return 0;
+    }
+
+    int i = find_event(p, e->id);
+    if (i < 0) {
+        planner_load_all(p);
+        i = find_event(p, e->id);
+    }
+    if (i < 0) {
+        set_message(p, "Event ID not found.");
+        return 0;
+    }
+
+    // The event may move to another month; keep both months resident
+    int old_index = segment_index(p->schedule.events[i].year, p->schedule.events[i].month);
+    int new_index = segment_index(e->year, e->month);
+    if (old_index != new_index) {
+        unsigned char wanted[MAX_SEGMENTS] = {0};
+        wanted[old_index] = 1;
+        wanted[new_index] = 1;
+        if (!ensure_segment_set_loaded(p, wanted)) return 0;
+        i = find_event(p, e->id);
+        if (i < 0) {
+            set_message(p, "Event ID not found.");
+            return 0;
+        }
+        mark_segment_dirty(p, old_index);
+        mark_segment_dirty(p, new_index);
+        p->segments[old_index].event_count--;
+        p->segments[new_index].event_count++;
+    } else {
+        mark_segment_dirty(p, new_index);
+    }
+
+    p->schedule.events[i] = *e;
+    return 1;
+}
+
+PlannerEvent *planner_events(Planner *p, int *count) {
+    *count = p->schedule.count;
+    return p->schedule.events;
+}
+
+// Compare function for sorting events by date and time
+int planner_compare_events(const void *a, const void *b) {
+    const PlannerEvent *e1 = a;
+    const PlannerEvent *e2 = b;
+
+    if (e1->year != e2->year) return e1->year - e2->year;
+    if (e1->month != e2->month) return e1->month - e2->month;
+    if (e1->day != e2->day) return e1->day - e2->day;
+    if (e1->hour != e2->hour) return e1->hour - e2->hour;
+    return e1->minute - e2->minute;
+}
+
+// Compare function for sorting events by priority
+static int compare_events_priority(const void *a, const void *b) {
+    const PlannerEvent *e1 = a;
+    const PlannerEvent *e2 = b;
+    return e1->priority - e2->priority;
+}
+
+void planner_sort(Planner *p, PlannerSortOrder order) {
+    qsort(p->schedule.events, (size_t)p->schedule.count, sizeof(PlannerEvent),
+          order == PLANNER_SORT_PRIORITY ? compare_events_priority : planner_compare_events);
+}
+
+// Case-insensitive substring test; needle must already be lowercase
+static int contains_ignore_case(const char *haystack, const char *needle) {
+    if (!needle[0]) return 1;
+    for (; *haystack; haystack++) {
+        int i = 0;
+        while (needle[i] && tolower((unsigned char)haystack[i]) == needle[i]) i++;
+        if (!needle[i]) return 1;
+    }
+    return 0;
+}
+
+static int date_key(int day, int month, int year) {
+    return year * 10000 + month * 100 + day;
+}
+
+int planner_query(Planner *p, const PlannerQuery *q, PlannerEventCallback cb, void *ctx) {
+    int ranged = planner_validate_date(q->from_day, q->from_month, q->from_year) &&
+                 planner_validate_date(q->to_day, q->to_month, q->to_year);
+
+    // A date range only needs its own months
+    if (ranged) {
+        int first = segment_index(q->from_year, q->from_month);
+        int last = segment_index(q->to_year, q->to_month);
+        if (first > last) return 0;
+        ensure_segments_loaded(p, first, last);
+    } else {
+        planner_load_all(p);
+    }
+
+    char keyword[PLANNER_DESCRIPTION_SIZE] = "", category[PLANNER_CATEGORY_SIZE] = "";
+    if (q->keyword) {
+        snprintf(keyword, sizeof(keyword), "%s", q->keyword);
+        for (int i = 0; keyword[i]; i++) keyword[i] = (char)tolower((unsigned char)keyword[i]);
+    }
+    if (q->category) {
+        snprintf(category, sizeof(category), "%s", q->category);
+        for (int i = 0; category[i]; i++) category[i] = (char)tolower((unsigned char)category[i]);
+    }
+
+    int from = ranged ? date_key(q->from_day, q->from_month, q->from_year) : 0;
+    int to = ranged ? date_key(q->to_day, q->to_month, q->to_year) : 0;
+    int found = 0;
+
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+
+        if (ranged) {
+            int key = date_key(e->day, e->month, e->year);
+            if (key < from || key > to) continue;
+        }
+        if (q->min_priority && e->priority < q->min_priority) continue;
+        if (q->max_priority && e->priority > q->max_priority) continue;
+        if (category[0] && !contains_ignore_case(e->category, category)) continue;
+        if (keyword[0] && !contains_ignore_case(e->description, keyword) &&
+            !contains_ignore_case(e->category, keyword)) continue;
+
+        found++;
+        if (cb && !cb(e, i, ctx)) break;
+    }
+    return found;
+}
+
+// ---- Buffers ----
+
+int planner_save_buffer(Planner *p, char **data, size_t *len) {
+    planner_load_all(p);
+
+    char *text = malloc((size_t)p->schedule.count * RECORD_SIZE + 1);
+    if (!text) return 0;
+
+    size_t text_len = 0;
+    for (int i = 0; i < p->schedule.count; i++) {
+        int n = format_record(text + text_len, RECORD_SIZE, &p->schedule.events[i]);
+        if (n > 0) text_len += (size_t)n;
+    }
+
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *fp = open_memstream(&out, &out_len);
+    if (!fp) {
+        free(text);
+        return 0;
+    }
+    int ok = write_container(fp, text, text_len, 1);
+    fclose(fp);
+    free(text);
+
+    if (!ok) {
+        free(out);
+        return 0;
+    }
+    *data = out;
+    *len = out_len;
+    return 1;
+}
+
+int planner_load_buffer(Planner *p, const char *data, size_t len) {
+    if (len < 4 || memcmp(data, CONTAINER_MAGIC, 4) != 0) {
+        set_message(p, "Buffer is not a planner snapshot.");
+        return 0;
+    }
+
+    FILE *fp = fmemopen((void *)(data + 4), len - 4, "rb");
+    if (!fp) return 0;
+
+    EventList incoming = {0};
+    int count, corrupt;
+    int loaded = read_container_events(fp, -1, &incoming, &count, &corrupt);
+    fclose(fp);
+    if (loaded < 0 || corrupt) {
+        free(incoming.events);
+        set_message(p, "Snapshot is corrupt.");
+        return 0;
+    }
+
+    // Replace everything: every month becomes resident and, if it had a
+    // file, dirty so the next save rewrites or removes it
+    p->schedule.count = 0;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        p->segments[i].event_count = 0;
+        p->segments[i].loaded = 1;
+        p->segments[i].dirty = p->segments[i].on_disk;
+    }
+    p->generation++;
+
+    if (!list_reserve(&p->schedule, loaded)) {
+        free(incoming.events);
+        return 0;
+    }
+    append_events(p, incoming.events, loaded);
+
+    // Keep this node's sequence ahead of any ID it issued before
+    for (int i = 0; i < loaded; i++) {
+        int64_t id = incoming.events[i].id;
+        int64_t sequence = id & (ID_SEQUENCE_LIMIT - 1);
+        if (id >> ID_NODE_SHIFT == p->node_id && sequence >= p->next_id) {
+            p->next_id = sequence + 1;
+        }
+    }
+
+    free(incoming.events);
+    if (loaded < count) {
+        set_message(p, "Warning: Skipped invalid event record.");
+    }
+    return 1;
+}
+
+// ---- Fuzzy search ----
+
+// The index maps each distinct word of the descriptions and categories to
+// the events containing it, and each padded trigram to the words containing
+// it. A query term only touches words that share enough trigrams with it,
+// and only the events of words that pass an edit distance check are scored.
+// Events are recorded by ID with what scoring needs, so loading, evicting
+// and sorting months leave the index valid.
+struct FuzzyIndex {
+    unsigned long generation; // Planner generation the index was built for
+    int event_count;
+    int64_t *event_id;        // Per indexed event
+    int *event_day;           // Days since 1970-01-01
+    int *event_segment;
+    unsigned char *event_priority;
+
+    int word_count, word_capacity;
+    char *word_text;          // All words, NUL-separated
+    size_t text_len, text_capacity;
+    int *word_offset;         // Start of each word in word_text
+    unsigned char *word_len;
+    int *word_slots;          // Hash table of word IDs (-1 = empty)
+    int slot_capacity;        // Power of two
+
+    int *posting_start;       // Word -> events, as offsets into postings
+    int *postings;            // Indexed events
+
+    uint64_t *grams;          // (trigram << 32 | word) pairs, sorted
+    int gram_count;
+
+    // Per-query scratch, sized to the words and events
+    int *shared;              // Trigrams a word shares with the current term
+    int *touched_words;
+    float *term_best;         // Best match quality of each event for the current term
+    float *total;             // Summed quality over all terms
+    unsigned *term_stamp, *total_stamp;
+    int *touched_events, *term_events;
+    unsigned stamp;
+};
+
+static void free_fuzzy_index(FuzzyIndex *index) {
+    if (!index) return;
+    free(index->event_id);
+    free(index->event_day);
+    free(index->event_segment);
+    free(index->event_priority);
+    free(index->word_text);
+    free(index->word_offset);
+    free(index->word_len);
+    free(index->word_slots);
+    free(index->posting_start);
+    free(index->postings);
+    free(index->grams);
+    free(index->shared);
+    free(index->touched_words);
+    free(index->term_best);
+    free(index->total);
+    free(index->term_stamp);
+    free(index->total_stamp);
+    free(index->touched_events);
+    free(index->term_events);
+    free(index);
+}
+
+// Split text into lowercase alphanumeric words; returns the number found
+static int tokenize(const char *text, char words[][MAX_WORD_LENGTH + 1], int max_words) {
+    int count = 0;
+    while (*text && count < max_words) {
+        while (*text && !isalnum((unsigned char)*text)) text++;
+        if (!*text) break;
+
+        int len = 0;
+        while (isalnum((unsigned char)*text)) {
+            if (len < MAX_WORD_LENGTH) words[count][len++] = (char)tolower((unsigned char)*text);
+            text++;
+        }
+        words[count][len] = '\0';
+        count++;
+    }
+    return count;
+}
+
+static uint32_t word_hash(const char *word) {
+    uint32_t h = 2166136261u;
+    for (; *word; word++) {
+        h = (h ^ (unsigned char)*word) * 16777619u;
+    }
+    return h;
+}
+
+// ID of word in the vocabulary, adding it if needed (-1 if out of memory)
+static int intern_word(FuzzyIndex *index, const char *word) {
+    if (index->word_count * 2 >= index->slot_capacity) {
+        int capacity = index->slot_capacity ? index->slot_capacity * 2 : 1024;
+        int *slots = malloc((size_t)capacity * sizeof(int));
+        if (!slots) return -1;
+        memset(slots, -1, (size_t)capacity * sizeof(int));
+        for (int w = 0; w < index->word_count; w++) {
+            uint32_t slot = word_hash(index->word_text + index->word_offset[w]) & (uint32_t)(capacity - 1);
+            while (slots[slot] >= 0) slot = (slot + 1) & (uint32_t)(capacity - 1);
+            slots[slot] = w;
+        }
+        free(index->word_slots);
+        index->word_slots = slots;
+        index->slot_capacity = capacity;
+    }
+
+    uint32_t mask = (uint32_t)(index->slot_capacity - 1);
+    uint32_t slot = word_hash(word) & mask;
+    while (index->word_slots[slot] >= 0) {
+        int w = index->word_slots[slot];
+        if (strcmp(index->word_text + index->word_offset[w], word) == 0) return w;
+        slot = (slot + 1) & mask;
+    }
+
+    size_t len = strlen(word);
+    if (index->text_len + len + 1 > index->text_capacity) {
+        size_t capacity = index->text_capacity ? index->text_capacity * 2 : 16384;
+        while (capacity < index->text_len + len + 1) capacity *= 2;
+        char *text = realloc(index->word_text, capacity);
+        if (!text) return -1;
+        index->word_text = text;
+        index->text_capacity = capacity;
+    }
+    if (index->word_count == index->word_capacity) {
+        int capacity = index->word_capacity ? index->word_capacity * 2 : 1024;
+        int *offsets = realloc(index->word_offset, (size_t)capacity * sizeof(int));
+        if (offsets) index->word_offset = offsets;
+        unsigned char *lens = realloc(index->word_len, (size_t)capacity);
+        if (lens) index->word_len = lens;
+        if (!offsets || !lens) return -1;
+        index->word_capacity = capacity;
+    }
+
+    int w = index->word_count++;
+    index->word_offset[w] = (int)index->text_len;
+    index->word_len[w] = (unsigned char)len;
+    memcpy(index->word_text + index->text_len, word, len + 1);
+    index->text_len += len + 1;
+    index->word_slots[slot] = w;
+    return w;
+}
+
+// Distinct trigrams of "$word$"; returns how many were written to grams
+static int word_trigrams(const char *word, uint32_t *grams) {
+    char padded[MAX_WORD_LENGTH + 3];
+    int len = snprintf(padded, sizeof(padded), "$%s$", word);
+    int count = 0;
+
+    for (int i = 0; i + 3 <= len; i++) {
+        uint32_t gram = (uint32_t)(unsigned char)padded[i] << 16 |
+                        (uint32_t)(unsigned char)padded[i + 1] << 8 |
+                        (uint32_t)(unsigned char)padded[i + 2];
+        int seen = 0;
+        for (int j = 0; j < count; j++) {
+            if (grams[j] == gram) {
+                seen = 1;
+                break;
+            }
+        }
+        if (!seen) grams[count++] = gram;
+    }
+    return count;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar
+static long days_from_civil(int day, int month, int year) {
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yoe = year - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Build the index over the resident events
+static FuzzyIndex *build_fuzzy_index(Planner *p) {
+    FuzzyIndex *index = calloc(1, sizeof(FuzzyIndex));
+    if (!index) return NULL;
+
+    int event_count = p->schedule.count;
+    index->event_count = event_count;
+    size_t events_size = (size_t)(event_count > 0 ? event_count : 1);
+    index->event_id = malloc(events_size * sizeof(int64_t));
+    index->event_day = malloc(events_size * sizeof(int));
+    index->event_segment = malloc(events_size * sizeof(int));
+    index->event_priority = malloc(events_size);
+
+    // First pass: intern every word and record (word, event) pairs
+    int pair_count = 0, pair_capacity = event_count * 4 + 16;
+    int *pair_word = malloc((size_t)pair_capacity * sizeof(int));
+    int *pair_event = malloc((size_t)pair_capacity * sizeof(int));
+    int ok = pair_word && pair_event && index->event_id && index->event_day &&
+             index->event_segment && index->event_priority;
+
+    char words[MAX_EVENT_WORDS][MAX_WORD_LENGTH + 1];
+    for (int i = 0; ok && i < event_count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        index->event_id[i] = e->id;
+        index->event_day[i] = (int)days_from_civil(e->day, e->month, e->year);
+        index->event_segment[i] = segment_index(e->year, e->month);
+        index->event_priority[i] = (unsigned char)e->priority;
+
+        int n = tokenize(e->description, words, MAX_EVENT_WORDS);
+        n += tokenize(e->category, words + n, MAX_EVENT_WORDS - n);
+
+        for (int k = 0; ok && k < n; k++) {
+            int w = intern_word(index, words[k]);
+            if (w < 0) {
+                ok = 0;
+                break;
+            }
+            if (pair_count == pair_capacity) {
+                pair_capacity *= 2;
+                int *pw = realloc(pair_word, (size_t)pair_capacity * sizeof(int));
+                if (pw) pair_word = pw;
+                int *pe = realloc(pair_event, (size_t)pair_capacity * sizeof(int));
+                if (pe) pair_event = pe;
+                if (!pw || !pe) {
+                    ok = 0;
+                    break;
+                }
+            }
+            pair_word[pair_count] = w;
+            pair_event[pair_count] = i;
+            pair_count++;
+        }
+    }
+
+    // Counting sort of the pairs into per-word posting lists
+    int words_total = index->word_count;
+    if (ok) {
+        index->posting_start = calloc((size_t)words_total + 1, sizeof(int));
+        index->postings = malloc((size_t)(pair_count > 0 ? pair_count : 1) * sizeof(int));
+        ok = index->posting_start && index->postings;
+    }
+    if (ok) {
+        for (int i = 0; i < pair_count; i++) index->posting_start[pair_word[i] + 1]++;
+        for (int w = 0; w < words_total; w++) index->posting_start[w + 1] += index->posting_start[w];
+
+        int *fill = malloc((size_t)(words_total > 0 ? words_total : 1) * sizeof(int));
+        ok = fill != NULL;
+        if (ok) {
+            memcpy(fill, index->posting_start, (size_t)words_total * sizeof(int));
+            for (int i = 0; i < pair_count; i++) {
+                index->postings[fill[pair_word[i]]++] = pair_event[i];
+            }
+            free(fill);
+        }
+    }
+    free(pair_word);
+    free(pair_event);
+
+    // Trigram -> word pairs, sorted so a trigram's words are contiguous
+    if (ok) {
+        index->grams = malloc((size_t)(index->text_len + 1) * sizeof(uint64_t));
+        ok = index->grams != NULL;
+    }
+    for (int w = 0; ok && w < words_total; w++) {
+        uint32_t grams[MAX_WORD_LENGTH + 1];
+        int n = word_trigrams(index->word_text + index->word_offset[w], grams);
+        for (int g = 0; g < n; g++) {
+            index->grams[index->gram_count++] = (uint64_t)grams[g] << 32 | (uint32_t)w;
+        }
+    }
+    if (ok) {
+        qsort(index->grams, (size_t)index->gram_count, sizeof(uint64_t), compare_u64);
+
+        size_t words_size = (size_t)(words_total > 0 ? words_total : 1);
+        index->shared = calloc(words_size, sizeof(int));
+        index->touched_words = malloc(words_size * sizeof(int));
+        index->term_best = malloc(events_size * sizeof(float));
+        index->total = malloc(events_size * sizeof(float));
+        index->term_stamp = calloc(events_size, sizeof(unsigned));
+        index->total_stamp = calloc(events_size, sizeof(unsigned));
+        index->touched_events = malloc(events_size * sizeof(int));
+        index->term_events = malloc(events_size * sizeof(int));
+        ok = index->shared && index->touched_words && index->term_best && index->total &&
+             index->term_stamp && index->total_stamp && index->touched_events && index->term_events;
+    }
+
+    if (!ok) {
+        free_fuzzy_index(index);
+        return NULL;
+    }
+    index->generation = p->generation;
+    return index;
+}
+
+// Levenshtein distance, or limit + 1 once it must exceed limit
+static int bounded_edit_distance(const char *a, int a_len, const char *b, int b_len, int limit) {
+    if (abs(a_len - b_len) > limit) return limit + 1;
+
+    int row[MAX_WORD_LENGTH + 1];
+    for (int j = 0; j <= b_len; j++) row[j] = j;
+
+    for (int i = 1; i <= a_len; i++) {
+        int diagonal = row[0];
+        int row_min = row[0] = i;
+        for (int j = 1; j <= b_len; j++) {
+            int above = row[j];
+            int cost = diagonal + (a[i - 1] != b[j - 1]);
+            if (above + 1 < cost) cost = above + 1;
+            if (row[j - 1] + 1 < cost) cost = row[j - 1] + 1;
+            row[j] = cost;
+            diagonal = above;
+            if (cost < row_min) row_min = cost;
+        }
+        if (row_min > limit) return limit + 1;
+    }
+    return row[b_len];
+}
+
+// Typos allowed in a query term of this length
+static int allowed_typos(int len) {
+    if (len <= 2) return 0;
+    if (len <= 5) return 1;
+    return 2;
+}
+
+// How well word matches term: 1 for an exact match, less per typo, a fixed
+// lower score for a prefix, 0 for no match
+static float match_quality(const char *term, int term_len, const char *word, int word_len) {
+    int limit = allowed_typos(term_len);
+    int distance = bounded_edit_distance(term, term_len, word, word_len, limit);
+    if (distance <= limit) return 1.0f - (float)distance / (float)(term_len + 1);
+    if (term_len >= 3 && word_len > term_len && strncmp(word, term, (size_t)term_len) == 0) {
+        return FUZZY_PREFIX_QUALITY;
+    }
+    return 0.0f;
+}
+
+// Give every event containing word at least this quality for the current term
+static void credit_word(FuzzyIndex *index, int word, float quality, int *term_event_count) {
+    for (int k = index->posting_start[word]; k < index->posting_start[word + 1]; k++) {
+        int e = index->postings[k];
+        if (index->term_stamp[e] != index->stamp) {
+            index->term_stamp[e] = index->stamp;
+            index->term_best[e] = quality;
+            index->term_events[(*term_event_count)++] = e;
+        } else if (quality > index->term_best[e]) {
+            index->term_best[e] = quality;
+        }
+    }
+}
+
+// Sift the lowest score to the root of a min-heap of matches
+static void heap_sift_down(PlannerMatch *heap, int count, int i) {
+    while (1) {
+        int smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && heap[left].score < heap[smallest].score) smallest = left;
+        if (right < count && heap[right].score < heap[smallest].score) smallest = right;
+        if (smallest == i) return;
+        PlannerMatch tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void heap_sift_up(PlannerMatch *heap, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent].score <= heap[i].score) return;
+        PlannerMatch tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static int compare_matches(const void *a, const void *b) {
+    const PlannerMatch *m1 = a;
+    const PlannerMatch *m2 = b;
+    if (m1->score != m2->score) return m1->score < m2->score ? 1 : -1;
+    return m1->index - m2->index;
+}
+
+int planner_fuzzy_search(Planner *p, const char *text, PlannerMatch *results, int k) {
+    if (k <= 0) return 0;
+
+    char terms[MAX_QUERY_TERMS][MAX_WORD_LENGTH + 1];
+    int term_count = tokenize(text, terms, MAX_QUERY_TERMS);
+    if (term_count == 0) return 0;
+
+    // Fuzzy search covers the whole history; the index is rebuilt only when
+    // events were added, changed or removed since it was built
+    if (!p->fuzzy || p->fuzzy->generation != p->generation) {
+        free_fuzzy_index(p->fuzzy);
+        planner_load_all(p);
+        p->fuzzy = build_fuzzy_index(p);
+        if (!p->fuzzy) {
+            set_message(p, "Not enough memory to build the search index.");
+            return 0;
+        }
+    }
+    FuzzyIndex *index = p->fuzzy;
+
+    int touched_event_count = 0;
+    unsigned query_stamp = ++index->stamp;
+
+    for (int t = 0; t < term_count; t++) {
+        const char *term = terms[t];
+        int term_len = (int)strlen(term);
+        int limit = allowed_typos(term_len);
+        int term_event_count = 0;
+        index->stamp++;
+
+        // Each typo destroys at most three trigrams; when that leaves no
+        // guaranteed shared trigram, check every word of a plausible length
+        int needed = term_len - 3 * limit;
+        if (needed <= 0) {
+            for (int w = 0; w < index->word_count; w++) {
+                int word_len = index->word_len[w];
+                if (word_len + limit < term_len) continue;
+                float quality = match_quality(term, term_len,
+                                              index->word_text + index->word_offset[w], word_len);
+                if (quality > 0) credit_word(index, w, quality, &term_event_count);
+            }
+        } else {
+            uint32_t grams[MAX_WORD_LENGTH + 1];
+            int gram_count = word_trigrams(term, grams);
+            int touched_word_count = 0;
+
+            for (int g = 0; g < gram_count; g++) {
+                uint64_t key = (uint64_t)grams[g] << 32;
+                int lo = 0, hi = index->gram_count;
+                while (lo < hi) {
+                    int mid = lo + (hi - lo) / 2;
+                    if (index->grams[mid] < key) lo = mid + 1;
+                    else hi = mid;
+                }
+                for (int i = lo; i < index->gram_count && index->grams[i] >> 32 == grams[g]; i++) {
+                    int w = (int)(uint32_t)index->grams[i];
+                    if (index->shared[w]++ == 0) index->touched_words[touched_word_count++] = w;
+                }
+            }
+
+            // A prefix of a longer word shares all but the closing trigram
+            int prefix_needed = gram_count - 1;
+            for (int i = 0; i < touched_word_count; i++) {
+                int w = index->touched_words[i];
+                int shared = index->shared[w];
+                index->shared[w] = 0;
+                if (shared < needed && shared < prefix_needed) continue;
+
+                float quality = match_quality(term, term_len, index->word_text + index->word_offset[w],
+                                              index->word_len[w]);
+                if (quality > 0) credit_word(index, w, quality, &term_event_count);
+            }
+        }
+
+        // Fold this term's best quality per event into the running totals
+        for (int i = 0; i < term_event_count; i++) {
+            int e = index->term_events[i];
+            if (index->total_stamp[e] != query_stamp) {
+                index->total_stamp[e] = query_stamp;
+                index->total[e] = 0;
+                index->touched_events[touched_event_count++] = e;
+            }
+            index->total[e] += index->term_best[e];
+        }
+    }
+
+    // Score the candidates, keeping the best k in a min-heap
+    time_t now = time(NULL);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    long today = days_from_civil(tm_now.tm_mday, tm_now.tm_mon + 1, tm_now.tm_year + 1900);
+    int found = 0;
+
+    for (int i = 0; i < touched_event_count; i++) {
+        int e = index->touched_events[i];
+        long days = labs(index->event_day[e] - today);
+        double score = FUZZY_MATCH_WEIGHT * index->total[e] / term_count +
+                       FUZZY_PRIORITY_WEIGHT * (5 - index->event_priority[e]) / 4.0 +
+                       FUZZY_PROXIMITY_WEIGHT / (1.0 + days / 7.0);
+
+        if (found < k) {
+            results[found] = (PlannerMatch){e, score};
+            heap_sift_up(results, found);
+            found++;
+        } else if (score > results[0].score) {
+            results[0] = (PlannerMatch){e, score};
+            heap_sift_down(results, k, 0);
+        }
+    }
+
+    // The results hold indexed events; only their months need to be
+    // resident to turn them into positions in planner_events(). Like
+    // planner_load_all, this leaves the LRU cap to the next ranged query.
+    IdTable positions;
+    if (!id_table_init(&positions, found)) {
+        set_message(p, "Not enough memory to search.");
+        return 0;
+    }
+    unsigned long used = ++p->segment_clock;
+    for (int i = 0; i < found; i++) {
+        int segment = index->event_segment[results[i].index];
+        load_segment(p, segment);
+        p->segments[segment].last_used = used;
+        id_table_put(&positions, index->event_id[results[i].index], -2);  // Not seen yet
+    }
+    for (int i = 0; i < p->schedule.count; i++) {
+        if (id_table_get(&positions, p->schedule.events[i].id) == -2) {
+            id_table_put(&positions, p->schedule.events[i].id, i);
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < found; i++) {
+        int position = id_table_get(&positions, index->event_id[results[i].index]);
+        if (position < 0) continue;  // Its month could not be loaded
+        results[kept].index = position;
+        results[kept].score = results[i].score;
+        kept++;
+    }
+    id_table_free(&positions);
+
+    qsort(results, (size_t)kept, sizeof(PlannerMatch), compare_matches);
+    return kept;
+}
+
+// ---- Reports ----
+
+// Category name -> row of per-month counts
+typedef struct {
+    int count;
+    int row_capacity;
+    int slot_capacity;        // Power of two
+    int columns;
+    char (*names)[PLANNER_CATEGORY_SIZE];
+    int *slots;               // Hash table of row numbers (-1 = empty)
+    int *counts;              // row_capacity * columns
+} CategoryTable;
+
+// One slice of a report: partial histograms over a range of the events
+typedef struct {
+    const PlannerEvent *events;
+    int first, last;
+    int first_segment;        // Column 0 of the month histograms
+    int month_count;
+    const unsigned char *first_weekday;  // Weekday of the 1st of each month
+    CategoryTable categories;
+    int *priority_month;
+    int weekday_hour[7][24];
+    int ok;
+} ReportSlice;
+
+static void category_table_free(CategoryTable *t) {
+    free(t->names);
+    free(t->slots);
+    free(t->counts);
+    memset(t, 0, sizeof(*t));
+}
+
+// Row for name, adding an empty one if needed (-1 if out of memory)
+static int category_table_row(CategoryTable *t, const char *name) {
+    if (t->count * 2 >= t->slot_capacity) {
+        int capacity = t->slot_capacity ? t->slot_capacity * 2 : 64;
+        int *slots = malloc((size_t)capacity * sizeof(int));
+        if (!slots) return -1;
+        memset(slots, -1, (size_t)capacity * sizeof(int));
+        for (int r = 0; r < t->count; r++) {
+            uint32_t slot = word_hash(t->names[r]) & (uint32_t)(capacity - 1);
+            while (slots[slot] >= 0) slot = (slot + 1) & (uint32_t)(capacity - 1);
+            slots[slot] = r;
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->slot_capacity = capacity;
+    }
+
+    uint32_t mask = (uint32_t)(t->slot_capacity - 1);
+    uint32_t slot = word_hash(name) & mask;
+    while (t->slots[slot] >= 0) {
+        int r = t->slots[slot];
+        if (strcmp(t->names[r], name) == 0) return r;
+        slot = (slot + 1) & mask;
+    }
+
+    if (t->count == t->row_capacity) {
+        int capacity = t->row_capacity ? t->row_capacity * 2 : 16;
+        char (*names)[PLANNER_CATEGORY_SIZE] = realloc(t->names, (size_t)capacity * PLANNER_CATEGORY_SIZE);
+        if (names) t->names = names;
+        int *counts = realloc(t->counts, (size_t)capacity * (size_t)t->columns * sizeof(int));
+        if (counts) t->counts = counts;
+        if (!names || !counts) return -1;
+        t->row_capacity = capacity;
+    }
+
+    int r = t->count++;
+    snprintf(t->names[r], PLANNER_CATEGORY_SIZE, "%s", name);
+    memset(t->counts + (size_t)r * t->columns, 0, (size_t)t->columns * sizeof(int));
+    t->slots[slot] = r;
+    return r;
+}
+
+// Fill one slice's histograms; a ParallelTask on ReportSlice items
+static void fill_report_slice(void *arg) {
+    ReportSlice *slice = arg;
+    int last_row = -1;
+    const char *last_name = NULL;
+
+    for (int i = slice->first; i < slice->last; i++) {
+        const PlannerEvent *e = &slice->events[i];
+        int month = segment_index(e->year, e->month) - slice->first_segment;
+
+        // Runs of the same category are common, so skip the hash lookup for them
+        int row = last_row;
+        if (!last_name || strcmp(last_name, e->category) != 0) {
+            row = category_table_row(&slice->categories, e->category);
+            if (row < 0) {
+                slice->ok = 0;
+                return;
+            }
+            last_row = row;
+            last_name = e->category;
+        }
+        slice->categories.counts[(size_t)row * slice->month_count + month]++;
+
+        if (e->priority >= 1 && e->priority <= 5) {
+            slice->priority_month[(e->priority - 1) * slice->month_count + month]++;
+        }
+
+        int weekday = (slice->first_weekday[month] + e->day - 1) % 7;
+        if (e->hour >= 0 && e->hour < 24) slice->weekday_hour[weekday][e->hour]++;
+    }
+    slice->ok = 1;
+}
+
+// A category row to sort by name; carries its name so the comparator needs
+// no shared state and concurrent reports on other handles are safe
+typedef struct {
+    const char *name;
+    int row;
+} CategoryOrder;
+
+static int compare_category_rows(const void *a, const void *b) {
+    return strcmp(((const CategoryOrder *)a)->name, ((const CategoryOrder *)b)->name);
+}
+
+void planner_free_report(PlannerReport *report) {
+    free(report->categories);
+    free(report->category_month);
+    free(report->priority_month);
+    memset(report, 0, sizeof(*report));
+}
+
+int planner_report(Planner *p, PlannerReport *report) {
+    memset(report, 0, sizeof(*report));
+    planner_load_all(p);
+
+    // Months covered: from the first to the last non-empty resident month
+    int first_segment = -1, last_segment = -1;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].loaded && p->segments[i].event_count > 0) {
+            if (first_segment < 0) first_segment = i;
+            last_segment = i;
+        }
+    }
+    report->total = p->schedule.count;
+    if (first_segment < 0 || p->schedule.count == 0) return 1;
+
+    int month_count = last_segment - first_segment + 1;
+    report->first_year = FIRST_YEAR + first_segment / 12;
+    report->first_month = first_segment % 12 + 1;
+    report->month_count = month_count;
+
+    // 1970-01-01 was a Thursday; weekday 0 is Monday
+    unsigned char first_weekday[MAX_SEGMENTS];
+    for (int m = 0; m < month_count; m++) {
+        int index = first_segment + m;
+        long days = days_from_civil(1, index % 12 + 1, FIRST_YEAR + index / 12);
+        first_weekday[m] = (unsigned char)(((days + 3) % 7 + 7) % 7);
+    }
+
+    // One slice per thread worth starting
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int slice_count = cpus > 0 ? (int)cpus : 1;
+    if (slice_count > MAX_THREADS) slice_count = MAX_THREADS;
+    if (slice_count > p->schedule.count / REPORT_EVENTS_PER_THREAD) {
+        slice_count = p->schedule.count / REPORT_EVENTS_PER_THREAD;
+    }
+    if (slice_count < 1) slice_count = 1;
+
+    ReportSlice *slices = calloc((size_t)slice_count, sizeof(ReportSlice));
+    if (!slices) return 0;
+
+    int ok = 1;
+    int per_slice = p->schedule.count / slice_count;
+    for (int t = 0; t < slice_count; t++) {
+        ReportSlice *slice = &slices[t];
+        slice->events = p->schedule.events;
+        slice->first = t * per_slice;
+        slice->last = t == slice_count - 1 ? p->schedule.count : (t + 1) * per_slice;
+        slice->first_segment = first_segment;
+        slice->month_count = month_count;
+        slice->first_weekday = first_weekday;
+        slice->categories.columns = month_count;
+        slice->priority_month = calloc((size_t)5 * month_count, sizeof(int));
+        if (!slice->priority_month) ok = 0;
+    }
+
+    // Each slice fills its own partial histograms; no sharing, no locks
+    if (ok) run_parallel(fill_report_slice, slices, sizeof(ReportSlice), slice_count);
+
+    // Merge the partial histograms
+    CategoryTable merged = {0};
+    merged.columns = month_count;
+    report->priority_month = calloc((size_t)5 * month_count, sizeof(int));
+    if (!report->priority_month) ok = 0;
+
+    for (int t = 0; ok && t < slice_count; t++) {
+        ReportSlice *slice = &slices[t];
+        if (!slice->ok) {
+            ok = 0;
+            break;
+        }
+        for (int r = 0; ok && r < slice->categories.count; r++) {
+            int row = category_table_row(&merged, slice->categories.names[r]);
+            if (row < 0) {
+                ok = 0;
+                break;
+            }
+            int *dst = merged.counts + (size_t)row * month_count;
+            const int *src = slice->categories.counts + (size_t)r * month_count;
+            for (int m = 0; m < month_count; m++) dst[m] += src[m];
+        }
+        for (int i = 0; i < 5 * month_count; i++) {
+            report->priority_month[i] += slice->priority_month[i];
+        }
+        for (int d = 0; d < 7; d++) {
+            for (int h = 0; h < 24; h++) report->weekday_hour[d][h] += slice->weekday_hour[d][h];
+        }
+    }
+
+    // Categories in name order
+    if (ok) {
+        CategoryOrder *order = malloc((size_t)(merged.count > 0 ? merged.count : 1) * sizeof(CategoryOrder));
+        report->categories = malloc((size_t)(merged.count > 0 ? merged.count : 1) * PLANNER_CATEGORY_SIZE);
+        report->category_month = malloc((size_t)(merged.count > 0 ? merged.count : 1) *
+                                        (size_t)month_count * sizeof(int));
+        ok = order && report->categories && report->category_month;
+        if (ok) {
+            for (int r = 0; r < merged.count; r++) {
+                order[r] = (CategoryOrder){merged.names[r], r};
+            }
+            qsort(order, (size_t)merged.count, sizeof(CategoryOrder), compare_category_rows);
+
+            for (int r = 0; r < merged.count; r++) {
+                memcpy(report->categories[r], merged.names[order[r].row], PLANNER_CATEGORY_SIZE);
+                memcpy(report->category_month + (size_t)r * month_count,
+                       merged.counts + (size_t)order[r].row * month_count,
+                       (size_t)month_count * sizeof(int));
+            }
+            report->category_count = merged.count;
+        }
+        free(order);
+    }
+
+    category_table_free(&merged);
+    for (int t = 0; t < slice_count; t++) {
+        category_table_free(&slices[t].categories);
+        free(slices[t].priority_month);
+    }
+    free(slices);
+
+    if (!ok) {
+        planner_free_report(report);
+        set_message(p, "Not enough memory to build the report.");
+    }
+    return ok;
+}
+
+// ---- Duplicates ----
+
+// Date and time in one comparable number
+static uint32_t packed_time(const PlannerEvent *e) {
+    return (((((uint32_t)e->year * 16 + (uint32_t)e->month) * 32 + (uint32_t)e->day) * 32 +
+             (uint32_t)e->hour) * 64) + (uint32_t)e->minute;
+}
+
+// Lowercase letters and digits, with every other run of characters turned
+// into a single space and no leading or trailing space
+static void normalize_text(const char *in, char *out, size_t size) {
+    size_t len = 0;
+    int gap = 0;
+    for (; *in && len + 2 < size; in++) {
+        char c = *in;
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            if (gap && len > 0) out[len++] = ' ';
+            out[len++] = c;
+            gap = 0;
+        } else {
+            gap = 1;
+        }
+    }
+    out[len] = '\0';
+}
+
+static uint64_t hash_bytes(uint64_t h, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Normalized texts of an event, for exact comparison and shingling
+typedef struct {
+    char category[PLANNER_CATEGORY_SIZE];
+    char description[PLANNER_DESCRIPTION_SIZE];
+} NormalizedEvent;
+
+static void normalize_event(const PlannerEvent *e, NormalizedEvent *n) {
+    normalize_text(e->category, n->category, sizeof(n->category));
+    normalize_text(e->description, n->description, sizeof(n->description));
+}
+
+// Hash of (time, category, description) that exact duplicates share
+static uint64_t exact_key(const PlannerEvent *e, const NormalizedEvent *n) {
+    uint32_t time_key = packed_time(e);
+    uint64_t h = hash_bytes(14695981039346656037ull, (const char *)&time_key, sizeof(time_key));
+    h = hash_bytes(h, n->category, strlen(n->category) + 1);
+    return hash_bytes(h, n->description, strlen(n->description));
+}
+
+// Hashes of the character trigrams of the description and category
+static int text_shingles(const NormalizedEvent *n, uint64_t *shingles) {
+    char text[MAX_SHINGLES + 1];
+    size_t desc_len = strlen(n->description);
+    size_t cat_len = strlen(n->category);
+    memcpy(text, n->description, desc_len);
+    text[desc_len] = ' ';
+    memcpy(text + desc_len + 1, n->category, cat_len);
+    int len = (int)(desc_len + 1 + cat_len);
+
+    if (len < SHINGLE_SIZE) {
+        shingles[0] = digest_add(0, hash_bytes(14695981039346656037ull, text, (size_t)len));
+        return 1;
+    }
+    for (int i = 0; i + SHINGLE_SIZE <= len; i++) {
+        shingles[i] = digest_add(0, hash_bytes(14695981039346656037ull, text + i, SHINGLE_SIZE));
+    }
+    return len - SHINGLE_SIZE + 1;
+}
+
+// MinHash signature over the shingles. The hash functions are derived from
+// the two halves of each shingle hash.
+static void minhash_signature(const NormalizedEvent *n, uint32_t *signature) {
+    uint64_t shingles[MAX_SHINGLES];
+    int count = text_shingles(n, shingles);
+
+    for (int k = 0; k < MINHASH_COUNT; k++) signature[k] = UINT32_MAX;
+    for (int i = 0; i < count; i++) {
+        uint32_t h1 = (uint32_t)shingles[i], h2 = (uint32_t)(shingles[i] >> 32) | 1;
+        for (int k = 0; k < MINHASH_COUNT; k++) {
+            uint32_t value = h1 + (uint32_t)k * h2;
+            if (value < signature[k]) signature[k] = value;
+        }
+    }
+}
+
+// Estimated Jaccard similarity: the share of equal signature slots
+static double signature_similarity(const uint32_t *a, const uint32_t *b) {
+    int equal = 0;
+    for (int k = 0; k < MINHASH_COUNT; k++) {
+        equal += a[k] == b[k];
+    }
+    return (double)equal / MINHASH_COUNT;
+}
+
+static int sorted_unique_shingles(const NormalizedEvent *n, uint64_t *shingles) {
+    int count = text_shingles(n, shingles);
+    // Texts are short, so an insertion sort beats qsort here
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        uint64_t value = shingles[i];
+        int j = unique;
+        while (j > 0 && shingles[j - 1] > value) j--;
+        if (j > 0 && shingles[j - 1] == value) continue;
+        memmove(shingles + j + 1, shingles + j, (size_t)(unique - j) * sizeof(uint64_t));
+        shingles[j] = value;
+        unique++;
+    }
+    return unique;
+}
+
+// Exact Jaccard similarity of the shingle sets, used to confirm candidates
+static double text_similarity(const NormalizedEvent *a, const NormalizedEvent *b) {
+    uint64_t sa[MAX_SHINGLES], sb[MAX_SHINGLES];
+    int na = sorted_unique_shingles(a, sa);
+    int nb = sorted_unique_shingles(b, sb);
+
+    int i = 0, j = 0, common = 0;
+    while (i < na && j < nb) {
+        if (sa[i] < sb[j]) {
+            i++;
+        } else if (sa[i] > sb[j]) {
+            j++;
+        } else {
+            common++;
+            i++;
+            j++;
+        }
+    }
+    return (double)common / (na + nb - common);
+}
+
+static int union_find_root(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Join two groups; the root is the event with the lower ID (the original)
+static void union_find_join(int *parent, const PlannerEvent *events, const int *member, int a, int b) {
+    a = union_find_root(parent, a);
+    b = union_find_root(parent, b);
+    if (a == b) return;
+    if (events[member[a]].id < events[member[b]].id) {
+        parent[b] = a;
+    } else {
+        parent[a] = b;
+    }
+}
+
+static int compare_duplicates(const void *a, const void *b) {
+    const PlannerDuplicate *d1 = a;
+    const PlannerDuplicate *d2 = b;
+    if (d1->keep_id != d2->keep_id) return d1->keep_id < d2->keep_id ? -1 : 1;
+    return d1->duplicate_id < d2->duplicate_id ? -1 : d1->duplicate_id > d2->duplicate_id;
+}
+
+// Find the duplicates among members first..last-1, which share a time.
+// Exact duplicates have equal keys; near duplicates land in the same LSH
+// bucket for at least one band of their signatures. Each bucket member is
+// checked against the first and the previous one, and the union-find joins
+// the rest of the group transitively.
+static void find_duplicates_at_time(const PlannerEvent *events, const int *member,
+                                    const NormalizedEvent *normalized, const uint32_t *signatures,
+                                    int *parent, unsigned char *exact, uint64_t *keys,
+                                    int first, int last) {
+    int size = last - first;
+
+    for (int m = first; m < last; m++) {
+        keys[m - first] = (exact_key(&events[member[m]], &normalized[m]) & ~(uint64_t)UINT32_MAX) | (uint32_t)m;
+    }
+    qsort(keys, (size_t)size, sizeof(uint64_t), compare_u64);
+    for (int i = 1; i < size; i++) {
+        if (keys[i] >> 32 != keys[i - 1] >> 32) continue;
+        int a = (int)(uint32_t)keys[i - 1], b = (int)(uint32_t)keys[i];
+        if (strcmp(normalized[a].category, normalized[b].category) == 0 &&
+            strcmp(normalized[a].description, normalized[b].description) == 0) {
+            union_find_join(parent, events, member, a, b);
+            exact[a] = exact[b] = 1;
+        }
+    }
+
+    for (int band = 0; band < LSH_BANDS; band++) {
+        for (int m = first; m < last; m++) {
+            const uint32_t *rows = signatures + (size_t)m * MINHASH_COUNT + band * LSH_ROWS;
+            uint64_t h = hash_bytes(14695981039346656037ull, (const char *)rows, LSH_ROWS * sizeof(uint32_t));
+            keys[m - first] = (h & ~(uint64_t)UINT32_MAX) | (uint32_t)m;
+        }
+        qsort(keys, (size_t)size, sizeof(uint64_t), compare_u64);
+
+        int start = 0;
+        for (int i = 1; i < size; i++) {
+            if (keys[i] >> 32 != keys[start] >> 32) {
+                start = i;
+                continue;
+            }
+            int b = (int)(uint32_t)keys[i];
+            int candidates[2] = {(int)(uint32_t)keys[start], (int)(uint32_t)keys[i - 1]};
+            for (int c = 0; c < (i - 1 > start ? 2 : 1); c++) {
+                int a = candidates[c];
+                if (union_find_root(parent, a) == union_find_root(parent, b)) continue;
+                // The signature estimate is cheap but noisy; it only
+                // filters out pairs that are clearly different
+                if (signature_similarity(signatures + (size_t)a * MINHASH_COUNT,
+                                         signatures + (size_t)b * MINHASH_COUNT) < DUPLICATE_SIMILARITY - 0.25) continue;
+                if (text_similarity(&normalized[a], &normalized[b]) >= DUPLICATE_SIMILARITY) {
+                    union_find_join(parent, events, member, a, b);
+                }
+            }
+        }
+    }
+}
+
+// Group the members (events sharing their time with another event, in time
+// order) into duplicates and list the events that duplicate their group's
+// root. Groups are joined transitively, so a member only similar to another
+// member is left out rather than reported against a root it does not match.
+static PlannerDuplicate *collect_duplicates(const PlannerEvent *events, const int *member,
+                                            const uint32_t *member_time, int members,
+                                            uint64_t *keys, int *count) {
+    NormalizedEvent *normalized = malloc((size_t)(members + 1) * sizeof(NormalizedEvent));
+    uint32_t *signatures = malloc((size_t)(members + 1) * MINHASH_COUNT * sizeof(uint32_t));
+    int *parent = malloc((size_t)(members + 1) * sizeof(int));
+    unsigned char *exact = calloc((size_t)(members + 1), 1);
+    PlannerDuplicate *out = NULL;
+
+    if (normalized && signatures && parent && exact) {
+        for (int m = 0; m < members; m++) {
+            normalize_event(&events[member[m]], &normalized[m]);
+            minhash_signature(&normalized[m], signatures + (size_t)m * MINHASH_COUNT);
+            parent[m] = m;
+        }
+
+        for (int first = 0, last; first < members; first = last) {
+            for (last = first + 1; last < members && member_time[last] == member_time[first]; last++);
+            find_duplicates_at_time(events, member, normalized, signatures, parent, exact, keys, first, last);
+        }
+
+        int found = 0;
+        for (int m = 0; m < members; m++) {
+            if (union_find_root(parent, m) != m) found++;
+        }
+        out = malloc((size_t)(found + 1) * sizeof(PlannerDuplicate));
+        if (out) {
+            int k = 0;
+            for (int m = 0; m < members; m++) {
+                int root = union_find_root(parent, m);
+                if (root == m) continue;
+
+                PlannerDuplicate *d = &out[k];
+                d->keep_index = member[root];
+                d->duplicate_index = member[m];
+                d->keep_id = events[member[root]].id;
+                d->duplicate_id = events[member[m]].id;
+                d->exact = exact[m] && exact[root] &&
+                           strcmp(normalized[m].category, normalized[root].category) == 0 &&
+                           strcmp(normalized[m].description, normalized[root].description) == 0;
+                d->similarity = d->exact ? 1.0 : text_similarity(&normalized[root], &normalized[m]);
+                if (d->exact || d->similarity >= DUPLICATE_SIMILARITY) k++;
+            }
+            qsort(out, (size_t)k, sizeof(PlannerDuplicate), compare_duplicates);
+            *count = k;
+        }
+    }
+
+    free(normalized);
+    free(signatures);
+    free(parent);
+    free(exact);
+    return out;
+}
+
+int planner_find_duplicates(Planner *p, PlannerDuplicate **pairs, int *count) {
+    *pairs = NULL;
+    *count = 0;
+    planner_load_all(p);
+
+    const PlannerEvent *events = p->schedule.events;
+    int n = p->schedule.count;
+    if (n < 2) return 1;
+
+    uint64_t *keys = malloc((size_t)n * sizeof(uint64_t));
+    int *member = malloc((size_t)n * sizeof(int));  // Member -> event index
+    uint32_t *member_time = malloc((size_t)n * sizeof(uint32_t));
+    if (!keys || !member || !member_time) {
+        free(keys);
+        free(member);
+        free(member_time);
+        set_message(p, "Not enough memory to look for duplicates.");
+        return 0;
+    }
+
+    // Duplicates share a time, so only events whose time is shared by
+    // another event need to be looked at. Sorting by time also keeps each
+    // time group contiguous.
+    for (int i = 0; i < n; i++) {
+        keys[i] = (uint64_t)packed_time(&events[i]) << 32 | (uint32_t)i;
+    }
+    qsort(keys, (size_t)n, sizeof(uint64_t), compare_u64);
+
+    int members = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t time_key = (uint32_t)(keys[i] >> 32);
+        if ((i > 0 && keys[i - 1] >> 32 == time_key) ||
+            (i + 1 < n && keys[i + 1] >> 32 == time_key)) {
+            member_time[members] = time_key;
+            member[members++] = (int)(uint32_t)keys[i];
+        }
+    }
+
+    *pairs = collect_duplicates(events, member, member_time, members, keys, count);
+    free(keys);
+    free(member);
+    free(member_time);
+    if (!*pairs) {
+        set_message(p, "Not enough memory to look for duplicates.");
+        return 0;
+    }
+    return 1;
+}
+
+int64_t planner_find_duplicate_of(Planner *p, const PlannerEvent *e, double *similarity) {
+    int index = segment_index(e->year, e->month);
+    ensure_segments_loaded(p, index, index);
+
+    NormalizedEvent target, other;
+    normalize_event(e, &target);
+
+    int64_t best_id = 0;
+    double best = 0;
+    uint32_t time_key = packed_time(e);
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *candidate = &p->schedule.events[i];
+        if (candidate->id == e->id || packed_time(candidate) != time_key) continue;
+
+        normalize_event(candidate, &other);
+        double score = text_similarity(&target, &other);
+        if (score >= DUPLICATE_SIMILARITY && score > best) {
+            best = score;
+            best_id = candidate->id;
+        }
+    }
+
+    *similarity = best;
+    return best_id;
+}
+
+// ---- Sync between copies ----
+
+static int id_table_init(IdTable *t, int expected) {
+    t->capacity = 16;
+    while (t->capacity < expected * 2) t->capacity <<= 1;
+    t->ids = calloc((size_t)t->capacity, sizeof(int64_t));
+    t->values = malloc((size_t)t->capacity * sizeof(int));
+    if (!t->ids || !t->values) {
+        id_table_free(t);
+        return 0;
+    }
+    return 1;
+}
+
+static void id_table_put(IdTable *t, int64_t id, int value) {
+    unsigned slot = (unsigned)(((uint64_t)id * 0x9e3779b97f4a7c15ull) >> 32) & (unsigned)(t->capacity - 1);
+    while (t->ids[slot] != 0 && t->ids[slot] != id) {
+        slot = (slot + 1) & (unsigned)(t->capacity - 1);
+    }
+    t->ids[slot] = id;
+    t->values[slot] = value;
+}
+
+// Returns the stored value, or -1 if the ID is not present
+static int id_table_get(const IdTable *t, int64_t id) {
+    unsigned slot = (unsigned)(((uint64_t)id * 0x9e3779b97f4a7c15ull) >> 32) & (unsigned)(t->capacity - 1);
+    while (t->ids[slot] != 0) {
+        if (t->ids[slot] == id) return t->values[slot];
+        slot = (slot + 1) & (unsigned)(t->capacity - 1);
+    }
+    return -1;
+}
+
+static void id_table_free(IdTable *t) {
+    free(t->ids);
+    free(t->values);
+    t->ids = NULL;
+    t->values = NULL;
+}
+
+static void free_sync_base(SyncBase *base) {
+    free(base->ids);
+    free(base->segment);
+    free(base->hash);
+    base->ids = NULL;
+    base->segment = NULL;
+    base->hash = NULL;
+    base->entry_count = 0;
+    base->capacity = 0;
+}
+
+// Append a base entry, growing the arrays as needed
+static int sync_base_add(SyncBase *base, int64_t id, int segment, uint64_t hash) {
+    if (base->entry_count == base->capacity) {
+        int grown = base->capacity ? base->capacity * 2 : 256;
+        int64_t *ids = realloc(base->ids, (size_t)grown * sizeof(int64_t));
+        if (ids) base->ids = ids;
+        int *segs = realloc(base->segment, (size_t)grown * sizeof(int));
+        if (segs) base->segment = segs;
+        uint64_t *hashes = realloc(base->hash, (size_t)grown * sizeof(uint64_t));
+        if (hashes) base->hash = hashes;
+        if (!ids || !segs || !hashes) return 0;
+        base->capacity = grown;
+    }
+    base->ids[base->entry_count] = id;
+    base->segment[base->entry_count] = segment;
+    base->hash[base->entry_count] = hash;
+    base->entry_count++;
+    return 1;
+}
+
+// Base file: "partitions entries", then "YYYY MM digest" per partition and
+// "id YYYY MM hash" per event. A missing file gives an empty base.
+static int load_sync_base(const char *path, SyncBase *base) {
+    memset(base, 0, sizeof(*base));
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    int partitions, entries;
+    if (fscanf(fp, "%d %d", &partitions, &entries) != 2 || partitions < 0 || entries < 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    for (int i = 0; i < partitions; i++) {
+        int year, month;
+        unsigned long long digest;
+        if (fscanf(fp, "%d %d %llx", &year, &month, &digest) != 3) break;
+        if (year >= FIRST_YEAR && year <= LAST_YEAR && month >= 1 && month <= 12) {
+            base->digest[segment_index(year, month)] = digest;
+        }
+    }
+
+    for (int i = 0; i < entries; i++) {
+        int64_t id;
+        int year, month;
+        unsigned long long hash;
+        if (fscanf(fp, "%" SCNd64 " %d %d %llx", &id, &year, &month, &hash) != 4) break;
+        if (year < FIRST_YEAR || year > LAST_YEAR || month < 1 || month > 12) continue;
+        if (!sync_base_add(base, id, segment_index(year, month), hash)) break;
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+static int write_sync_base(Planner *p, const char *path, const SyncBase *base) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        set_message(p, "Error opening %s for writing.", path);
+        return 0;
+    }
+
+    int partitions = 0;
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (base->digest[i]) partitions++;
+    }
+
+    fprintf(fp, "%d %d\n", partitions, base->entry_count);
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (base->digest[i]) {
+            fprintf(fp, "%d %d %016llx\n", FIRST_YEAR + i / 12, i % 12 + 1,
+                    (unsigned long long)base->digest[i]);
+        }
+    }
+    for (int i = 0; i < base->entry_count; i++) {
+        fprintf(fp, "%" PRId64 " %d %d %016llx\n", base->ids[i],
+                FIRST_YEAR + base->segment[i] / 12, base->segment[i] % 12 + 1,
+                (unsigned long long)base->hash[i]);
+    }
+
+    return fclose(fp) == 0;
+}
+
+// Digest of a segment file that the manifest has no digest for
+static uint64_t segment_file_digest(Planner *p, const char *dir, int index, int *count) {
+    EventList scratch = {0};
+    char path[PATH_SIZE];
+    segment_path(path, sizeof(path), dir, index);
+
+    int claimed;
+    int n = read_segment_file(p, path, index, &scratch, &claimed);
+    uint64_t digest = 0;
+    for (int i = 0; i < n; i++) {
+        digest = digest_add(digest, event_hash(&scratch.events[i]));
+    }
+    free(scratch.events);
+    *count = n > 0 ? n : 0;
+    return digest;
+}
+
+// Merge the differing partitions, already resident here and read into
+// theirs. Resolves every event ID present on either side. Returns 0, with
+// nothing changed, if memory runs out.
+static int merge_partitions(Planner *p, const unsigned char *differs, const EventList *theirs,
+                            const SyncBase *base, PlannerSyncReport *report,
+                            PlannerConflictCallback on_conflict, void *ctx) {
+    IdTable ours_by_id = {0}, theirs_by_id = {0}, base_by_id = {0};
+    unsigned char *remove_here = calloc((size_t)p->schedule.count + 1, 1);
+    // Room for every event of the other copy, so appending below cannot fail
+    int ok = remove_here && list_reserve(&p->schedule, theirs->count);
+    ok = ok && id_table_init(&ours_by_id, p->schedule.count);
+    ok = ok && id_table_init(&theirs_by_id, theirs->count);
+    ok = ok && id_table_init(&base_by_id, base->entry_count);
+    if (!ok) {
+        id_table_free(&ours_by_id);
+        id_table_free(&theirs_by_id);
+        id_table_free(&base_by_id);
+        free(remove_here);
+        set_message(p, "Not enough memory to merge the changes.");
+        return 0;
+    }
+
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        if (differs[segment_index(e->year, e->month)]) {
+            id_table_put(&ours_by_id, e->id, i);
+        }
+    }
+    for (int i = 0; i < theirs->count; i++) {
+        id_table_put(&theirs_by_id, theirs->events[i].id, i);
+    }
+    for (int i = 0; i < base->entry_count; i++) {
+        if (differs[base->segment[i]]) {
+            id_table_put(&base_by_id, base->ids[i], i);
+        }
+    }
+
+    // Events present here
+    int local_count = p->schedule.count;
+    for (int i = 0; i < local_count; i++) {
+        PlannerEvent *e = &p->schedule.events[i];
+        if (!differs[segment_index(e->year, e->month)]) continue;
+
+        int t = id_table_get(&theirs_by_id, e->id);
+        int b = id_table_get(&base_by_id, e->id);
+        uint64_t ours_hash = event_hash(e);
+
+        if (t >= 0) {
+            uint64_t theirs_hash = event_hash(&theirs->events[t]);
+            if (ours_hash == theirs_hash) continue;
+
+            if (b >= 0 && base->hash[b] == ours_hash) {
+                *e = theirs->events[t];
+                report->updated_here++;
+            } else {
+                if (!(b >= 0 && base->hash[b] == theirs_hash)) {
+                    if (on_conflict) {
+                        on_conflict(e->id, "changed in both copies; kept this copy's version",
+                                    &theirs->events[t], ctx);
+                    }
+                    report->conflicts++;
+                }
+                report->sent++;
+            }
+        } else if (b < 0) {
+            report->sent++;  // New here
+        } else if (base->hash[b] == ours_hash) {
+            remove_here[i] = 1;  // Deleted in the other copy
+            report->deleted_here++;
+        } else {
+            if (on_conflict) {
+                on_conflict(e->id, "changed here but deleted in the other copy; kept it", NULL, ctx);
+            }
+            report->conflicts++;
+            report->sent++;
+        }
+    }
+
+    // Events only in the other copy
+    for (int t = 0; t < theirs->count; t++) {
+        const PlannerEvent *e = &theirs->events[t];
+        if (id_table_get(&ours_by_id, e->id) >= 0) continue;
+
+        int b = id_table_get(&base_by_id, e->id);
+        if (b >= 0 && base->hash[b] == event_hash(e)) {
+            report->sent++;  // Deleted here; the deletion goes to the other copy
+            continue;
+        }
+        if (b >= 0) {
+            if (on_conflict) {
+                on_conflict(e->id, "deleted here but changed in the other copy; restored it", e, ctx);
+            }
+            report->conflicts++;
+        }
+        // Appended past local_count, so it is never marked for removal
+        p->schedule.events[p->schedule.count++] = *e;
+        report->added_here++;
+    }
+
+    // Drop events deleted in the other copy
+    int kept = 0;
+    for (int i = 0; i < p->schedule.count; i++) {
+        if (i < local_count && remove_here[i]) continue;
+        if (kept != i) p->schedule.events[kept] = p->schedule.events[i];
+        kept++;
+    }
+    p->schedule.count = kept;
+    free(remove_here);
+
+    // Recount the resident segments
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].loaded) p->segments[i].event_count = 0;
+    }
+    for (int i = 0; i < p->schedule.count; i++) {
+        const PlannerEvent *e = &p->schedule.events[i];
+        p->segments[segment_index(e->year, e->month)].event_count++;
+    }
+    p->generation++;
+
+    id_table_free(&ours_by_id);
+    id_table_free(&theirs_by_id);
+    id_table_free(&base_by_id);
+    return 1;
+}
+
+// Give this copy a new node ID when the other copy has the same one, as
+// happens when a directory was copied before copies were detected at open.
+// Events of the old node keep their IDs if the other copy holds them
+// unchanged or an earlier sync recorded them; the rest were created since
+// the copies split and are renumbered under the new node, so both copies'
+// events survive the merge. Called with disk matching memory.
+static int split_node_id(Planner *p, const char *peer_dir, const Manifest *peer) {
+    if (!planner_load_all(p)) return 0;
+
+    // IDs recorded by earlier syncs, with any copy
+    SyncBase recorded;
+    memset(&recorded, 0, sizeof(recorded));
+    int ok = 1;
+    DIR *d = opendir(p->dir);
+    if (d) {
+        struct dirent *entry;
+        while (ok && (entry = readdir(d)) != NULL) {
+            size_t len = strlen(entry->d_name);
+            if (strncmp(entry->d_name, "sync-", 5) != 0 || len < 10 ||
+                strcmp(entry->d_name + len - 5, ".base") != 0) {
+                continue;
+            }
+            char path[PATH_SIZE];
+            SyncBase base;
+            snprintf(path, sizeof(path), "%s/%s", p->dir, entry->d_name);
+            load_sync_base(path, &base);
+            for (int k = 0; ok && k < base.entry_count; k++) {
+                ok = sync_base_add(&recorded, base.ids[k], base.segment[k], base.hash[k]);
+            }
+            free_sync_base(&base);
+        }
+        closedir(d);
+    }
+
+    // The other copy's events in the partitions that differ
+    EventList theirs = {0};
+    for (int i = 0; ok && i < MAX_SEGMENTS; i++) {
+        if (!p->segments[i].on_disk || !peer->on_disk[i] ||
+            p->segments[i].digest == peer->digest[i]) {
+            continue;
+        }
+        char path[PATH_SIZE];
+        int claimed;
+        segment_path(path, sizeof(path), peer_dir, i);
+        if (read_segment_file(p, path, i, &theirs, &claimed) < 0) ok = 0;
+    }
+
+    IdTable recorded_ids = {0}, theirs_by_id = {0};
+    ok = ok && id_table_init(&recorded_ids, recorded.entry_count);
+    ok = ok && id_table_init(&theirs_by_id, theirs.count);
+    if (ok) {
+        for (int i = 0; i < recorded.entry_count; i++) {
+            id_table_put(&recorded_ids, recorded.ids[i], i);
+        }
+        for (int i = 0; i < theirs.count; i++) {
+            id_table_put(&theirs_by_id, theirs.events[i].id, i);
+        }
+
+        int old_node = p->node_id;
+        assign_node_id(p);
+        if (p->node_id == old_node) p->node_id = old_node % MAX_NODE_ID + 1;
+        p->next_id = 1;
+
+        int renumbered = 0;
+        for (int i = 0; i < p->schedule.count; i++) {
+            PlannerEvent *e = &p->schedule.events[i];
+            int index = segment_index(e->year, e->month);
+            if (e->id >> ID_NODE_SHIFT != old_node ||
+                (peer->on_disk[index] && peer->digest[index] == p->segments[index].digest) ||
+                id_table_get(&recorded_ids, e->id) >= 0) {
+                continue;
+            }
+            int t = id_table_get(&theirs_by_id, e->id);
+            if (t >= 0 && event_hash(&theirs.events[t]) == event_hash(e)) continue;
+
+            mark_segment_dirty(p, index);
+            e->id = ((int64_t)p->node_id << ID_NODE_SHIFT) + p->next_id++;
+            renumbered++;
+        }
+
+        // The manifest takes the new node ID even if nothing was renumbered
+        ok = planner_save(p) && save_manifest(p);
+        if (ok) {
+            set_message(p, "Both copies used node ID %d; this copy now uses node ID %d "
+                        "(%d events renumbered).", old_node, p->node_id, renumbered);
+        }
+    } else {
+        set_message(p, "Not enough memory to give this copy its own node ID.");
+    }
+
+    id_table_free(&recorded_ids);
+    id_table_free(&theirs_by_id);
+    free_sync_base(&recorded);
+    free(theirs.events);
+    return ok;
+}
+
+// Two-way sync with another copy of the schedule. Partitions whose digests
+// match are skipped; the rest are merged event by event against the state
+// recorded after the previous sync with that copy (a three-way merge).
+// Edits win over deletions, and when both sides edited an event the local
+// version is kept and the conflict is reported.
+static int sync_with_peer(Planner *p, const char *peer_dir, PlannerSyncReport *report,
+                          PlannerConflictCallback on_conflict, void *ctx) {
+
+    char local_real[PATH_MAX], peer_real[PATH_MAX];
+    if (!realpath(peer_dir, peer_real) || !realpath(p->dir, local_real)) {
+        set_message(p, "Directory not found.");
+        return 0;
+    }
+    if (strcmp(local_real, peer_real) == 0) {
+        set_message(p, "That directory is this schedule.");
+        return 0;
+    }
+
+    Manifest *peer = malloc(sizeof(Manifest));
+    unsigned char *differs = calloc(MAX_SEGMENTS, 1);
+    if (!peer || !differs) {
+        free(peer);
+        free(differs);
+        return 0;
+    }
+    if (!read_manifest_file(p, peer_real, peer)) {
+        set_message(p, "No schedule manifest found in %s.", peer_real);
+        free(peer);
+        free(differs);
+        return 0;
+    }
+
+    // Local disk must match memory before digests are compared
+    if (!planner_save(p)) {
+        free(peer);
+        free(differs);
+        return 0;
+    }
+    p->message[0] = '\0';
+
+    // Older manifests carry no digests; compute them from the files once
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].on_disk && p->segments[i].digest == 0) {
+            int count;
+            p->segments[i].digest = segment_file_digest(p, p->dir, i, &count);
+        }
+        if (peer->on_disk[i] && peer->digest[i] == 0) {
+            peer->digest[i] = segment_file_digest(p, peer_real, i, &peer->event_count[i]);
+        }
+    }
+
+    // The same node ID on both sides means the same ID may name different
+    // events, so nothing is merged until this copy has its own
+    if (peer->node_id == p->node_id && !split_node_id(p, peer_real, peer)) {
+        free(peer);
+        free(differs);
+        return 0;
+    }
+
+    // Each copy keeps the base in its own directory, named after the other
+    // copy's node ID, so the next sync finds it whichever side starts it
+    char base_path[PATH_SIZE], peer_base_path[PATH_SIZE];
+    snprintf(base_path, sizeof(base_path), "%s/sync-node-%d.base", p->dir, peer->node_id);
+    snprintf(peer_base_path, sizeof(peer_base_path), "%s/sync-node-%d.base",
+             peer_real, p->node_id);
+
+    SyncBase base;
+    if (!load_sync_base(base_path, &base)) {
+        // Earlier versions kept it only here, named after a hash of the path
+        uint64_t peer_key = 14695981039346656037ull;
+        for (const char *c = peer_real; *c; c++) {
+            peer_key = (peer_key ^ (unsigned char)*c) * 1099511628211ull;
+        }
+        char old_path[PATH_SIZE];
+        snprintf(old_path, sizeof(old_path), "%s/sync-%016llx.base",
+                 p->dir, (unsigned long long)peer_key);
+        load_sync_base(old_path, &base);
+    }
+
+    // Partitions that differ between the two copies
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        uint64_t ours = p->segments[i].on_disk ? p->segments[i].digest : 0;
+        uint64_t theirs = peer->on_disk[i] ? peer->digest[i] : 0;
+        differs[i] = ours != theirs;
+        if (p->segments[i].on_disk || peer->on_disk[i]) report->partitions_compared++;
+        if (differs[i]) report->partitions_differed++;
+    }
+
+    int ok = 1;
+    if (report->partitions_differed > 0) {
+        EventList theirs = {0};
+        for (int i = 0; ok && i < MAX_SEGMENTS; i++) {
+            if (!differs[i]) continue;
+            if (!load_segment(p, i)) {
+                ok = 0;
+                break;
+            }
+            if (!peer->on_disk[i]) continue;
+
+            char path[PATH_SIZE];
+            int claimed;
+            segment_path(path, sizeof(path), peer_real, i);
+            if (read_segment_file(p, path, i, &theirs, &claimed) < 0) ok = 0;
+        }
+
+        if (ok) ok = merge_partitions(p, differs, &theirs, &base, report, on_conflict, ctx);
+        if (ok) {
+            // Saved straight away, so no base snapshot is needed
+            for (int i = 0; i < MAX_SEGMENTS; i++) {
+                if (differs[i]) p->segments[i].dirty = 1;
+            }
+            ok = planner_save(p);
+        }
+
+        // The other copy gets the same merged partitions
+        for (int i = 0; ok && i < MAX_SEGMENTS; i++) {
+            if (!differs[i]) continue;
+
+            char path[PATH_SIZE];
+            segment_path(path, sizeof(path), peer_real, i);
+            int written = write_segment_file(p, path, i, p->schedule.events, p->schedule.count,
+                                             peer->compress, &peer->digest[i]);
+            if (written < 0) {
+                ok = 0;
+                break;
+            }
+            peer->event_count[i] = written;
+            peer->on_disk[i] = written > 0;
+        }
+        peer->generation++;  // Lets a planner running on the other copy reload
+        if (ok) ok = write_manifest_file(p, peer_real, peer);
+        free(theirs.events);
+    }
+
+    // Record the agreed state in both copies. Partitions whose digest still
+    // matches the old base keep their entries; only the others are rehashed.
+    if (ok) {
+        SyncBase next;
+        memset(&next, 0, sizeof(next));
+
+        for (int i = 0; i < MAX_SEGMENTS; i++) {
+            if (!p->segments[i].on_disk) continue;
+            next.digest[i] = p->segments[i].digest;
+
+            if (!differs[i] && base.digest[i] == p->segments[i].digest) {
+                for (int k = 0; ok && k < base.entry_count; k++) {
+                    if (base.segment[k] == i) {
+                        ok = sync_base_add(&next, base.ids[k], i, base.hash[k]);
+                    }
+                }
+            } else if (p->segments[i].loaded) {
+                for (int k = 0; ok && k < p->schedule.count; k++) {
+                    const PlannerEvent *e = &p->schedule.events[k];
+                    if (segment_index(e->year, e->month) == i) {
+                        ok = sync_base_add(&next, e->id, i, event_hash(e));
+                    }
+                }
+            } else {
+                EventList scratch = {0};
+                char path[PATH_SIZE];
+                int claimed;
+                segment_path(path, sizeof(path), p->dir, i);
+                int n = read_segment_file(p, path, i, &scratch, &claimed);
+                for (int k = 0; ok && k < n; k++) {
+                    ok = sync_base_add(&next, scratch.events[k].id, i, event_hash(&scratch.events[k]));
+                }
+                free(scratch.events);
+            }
+        }
+        if (ok) {
+            ok = write_sync_base(p, base_path, &next) &&
+                 write_sync_base(p, peer_base_path, &next);
+        } else {
+            set_message(p, "Not enough memory to record the synced state.");
+        }
+        free_sync_base(&next);
+    }
+
+    free_sync_base(&base);
+    free(peer);
+    free(differs);
+    return ok;
+}
+
+// Both directories stay locked for the whole sync. The other copy's lock is
+// only tried, so two copies syncing with each other cannot deadlock.
+int planner_sync(Planner *p, const char *peer_dir, PlannerSyncReport *report,
+                 PlannerConflictCallback on_conflict, void *ctx) {
+    memset(report, 0, sizeof(*report));
+
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", peer_dir, LOCK_FILE);
+    int peer_lock = open(path, O_RDWR | O_CLOEXEC);
+    if (peer_lock >= 0 && flock(peer_lock, LOCK_EX | LOCK_NB) < 0) {
+        close(peer_lock);
+        set_message(p, "The other copy is being saved by another process; try again.");
+        return 0;
+    }
+
+    lock_schedule(p, LOCK_EX);
+    int ok = sync_with_peer(p, peer_dir, report, on_conflict, ctx);
+    unlock_schedule(p);
+
+    if (peer_lock >= 0) close(peer_lock);
+    return ok;
+}
+
+// ---- Calendars ----
+
+typedef struct {
+    char name[CALENDAR_NAME_SIZE];
+    Planner *planner;         // NULL until first used, and again once evicted
+    unsigned long last_used;
+} Calendar;
+
+struct PlannerCalendars {
+    char dir[PATH_MAX];       // Holds the "main" calendar and calendars/<name>
+    Calendar calendars[MAX_CALENDARS];
+    int count;
+    int selected;             // Never evicted; the caller is working in it
+    size_t memory_cap;        // Bytes of resident events across all calendars
+    unsigned long clock;
+    char message[256];
+};
+
+// One calendar's share of an agenda, filled on its own thread
+typedef struct {
+    Planner *planner;
+    const PlannerQuery *query;
+    int *matches;             // Indices into planner_events(), in date and time order
+    int count, capacity;
+    int ok;
+} AgendaJob;
+
+static void set_calendars_message(PlannerCalendars *c, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(c->message, sizeof(c->message), format, args);
+    va_end(args);
+}
+
+static int compare_calendar_names(const void *a, const void *b) {
+    return strcmp(((const Calendar *)a)->name, ((const Calendar *)b)->name);
+}
+
+static int valid_calendar_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= CALENDAR_NAME_SIZE || strcmp(name, MAIN_CALENDAR) == 0) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '-' && name[i] != '_') return 0;
+    }
+    return 1;
+}
+
+static void calendar_dir(const PlannerCalendars *c, int calendar, char *path, size_t size) {
+    if (calendar == 0) {
+        snprintf(path, size, "%s", c->dir);
+    } else {
+        snprintf(path, size, "%s/%s/%s", c->dir, CALENDARS_DIR, c->calendars[calendar].name);
+    }
+}
+
+PlannerCalendars *planner_calendars_open(const char *dir, size_t memory_cap) {
+    PlannerCalendars *c = calloc(1, sizeof(PlannerCalendars));
+    if (!c) return NULL;
+
+    snprintf(c->dir, sizeof(c->dir), "%s", dir && dir[0] ? dir : ".");
+    c->memory_cap = memory_cap;
+    snprintf(c->calendars[0].name, CALENDAR_NAME_SIZE, "%s", MAIN_CALENDAR);
+    c->count = 1;
+
+    // Only the names are read here; each calendar opens on first use
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", c->dir, CALENDARS_DIR);
+    DIR *d = opendir(path);
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (!valid_calendar_name(entry->d_name)) continue;
+            if (c->count == MAX_CALENDARS) {
+                set_calendars_message(c, "Only the first %d calendars can be opened.", MAX_CALENDARS);
+                break;
+            }
+            strcpy(c->calendars[c->count++].name, entry->d_name);
+        }
+        closedir(d);
+    }
+    qsort(c->calendars + 1, (size_t)(c->count - 1), sizeof(Calendar), compare_calendar_names);
+    return c;
+}
+
+void planner_calendars_close(PlannerCalendars *c) {
+    if (!c) return;
+    for (int i = 0; i < c->count; i++) {
+        planner_close(c->calendars[i].planner);
+    }
+    free(c);
+}
+
+int planner_calendars_save(PlannerCalendars *c) {
+    int ok = 1;
+    for (int i = 0; i < c->count; i++) {
+        Planner *p = c->calendars[i].planner;
+        if (p && !planner_save(p)) {
+            set_calendars_message(c, "Calendar %s: %s", c->calendars[i].name, planner_last_message(p));
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+const char *planner_calendars_last_message(const PlannerCalendars *c) {
+    return c->message;
+}
+
+void planner_calendars_clear_message(PlannerCalendars *c) {
+    c->message[0] = '\0';
+}
+
+int planner_calendar_count(const PlannerCalendars *c) {
+    return c->count;
+}
+
+const char *planner_calendar_name(const PlannerCalendars *c, int calendar) {
+    return c->calendars[calendar].name;
+}
+
+int planner_calendar_find(const PlannerCalendars *c, const char *name) {
+    for (int i = 0; i < c->count; i++) {
+        if (strcmp(c->calendars[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int planner_calendar_event_count(const PlannerCalendars *c, int calendar) {
+    const Planner *p = c->calendars[calendar].planner;
+    return p ? planner_total_count(p) : -1;
+}
+
+int planner_calendar_create(PlannerCalendars *c, const char *name) {
+    if (!valid_calendar_name(name)) {
+        set_calendars_message(c, "Calendar names use letters, digits, '-' and '_' (and \"%s\" is taken).",
+                              MAIN_CALENDAR);
+        return -1;
+    }
+    if (planner_calendar_find(c, name) >= 0) {
+        set_calendars_message(c, "Calendar %s already exists.", name);
+        return -1;
+    }
+    if (c->count == MAX_CALENDARS) {
+        set_calendars_message(c, "Too many calendars (at most %d).", MAX_CALENDARS);
+        return -1;
+    }
+
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", c->dir, CALENDARS_DIR);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/%s/%s", c->dir, CALENDARS_DIR, name);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        set_calendars_message(c, "Cannot create %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    // Keep the list sorted by name after "main"
+    int index = c->count++;
+    while (index > 1 && strcmp(c->calendars[index - 1].name, name) > 0) {
+        c->calendars[index] = c->calendars[index - 1];
+        index--;
+    }
+    memset(&c->calendars[index], 0, sizeof(Calendar));
+    snprintf(c->calendars[index].name, CALENDAR_NAME_SIZE, "%s", name);
+    if (c->selected >= index && c->selected != 0) c->selected++;
+    return index;
+}
+
+static size_t calendar_memory(const Calendar *cal) {
+    return cal->planner ? (size_t)cal->planner->schedule.capacity * sizeof(PlannerEvent) : 0;
+}
+
+static int has_unsaved_changes(const Planner *p) {
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (p->segments[i].dirty) return 1;
+    }
+    return 0;
+}
+
+// Close the least recently used calendars until the resident events fit
+// under the cap. Like evicted months, calendars with unsaved changes are
+// never written or dropped here; the selected and pinned ones stay open too.
+static void enforce_memory_cap(PlannerCalendars *c, const unsigned char *pinned) {
+    while (1) {
+        size_t total = 0;
+        int victim = -1;
+        for (int i = 0; i < c->count; i++) {
+            Calendar *cal = &c->calendars[i];
+            total += calendar_memory(cal);
+            if (!cal->planner || i == c->selected || (pinned && pinned[i]) ||
+                has_unsaved_changes(cal->planner)) continue;
+            if (victim < 0 || cal->last_used < c->calendars[victim].last_used) victim = i;
+        }
+        if (total <= c->memory_cap || victim < 0) return;
+
+        Calendar *cal = &c->calendars[victim];
+        planner_close(cal->planner);
+        cal->planner = NULL;
+    }
+}
+
+// Open a calendar if needed, without evicting anything
+static Planner *use_calendar(PlannerCalendars *c, int calendar) {
+    Calendar *cal = &c->calendars[calendar];
+    cal->last_used = ++c->clock;
+    if (cal->planner) return cal->planner;
+
+    char path[PATH_SIZE];
+    calendar_dir(c, calendar, path, sizeof(path));
+    cal->planner = planner_open(path);
+    if (!cal->planner) {
+        set_calendars_message(c, "Not enough memory to open calendar %s.", cal->name);
+    } else if (calendar != 0 && strcmp(planner_last_message(cal->planner), NO_SCHEDULE_MESSAGE) == 0) {
+        planner_clear_message(cal->planner);  // A new calendar starts empty
+    }
+    return cal->planner;
+}
+
+Planner *planner_calendar(PlannerCalendars *c, int calendar) {
+    if (calendar < 0 || calendar >= c->count) return NULL;
+
+    Planner *p = use_calendar(c, calendar);
+    unsigned char pinned[MAX_CALENDARS] = {0};
+    pinned[calendar] = 1;
+    enforce_memory_cap(c, pinned);
+    return p;
+}
+
+// The previous selection keeps its protection until the new one is open,
+// since the caller still holds its handle if opening fails
+Planner *planner_calendar_select(PlannerCalendars *c, int calendar) {
+    Planner *p = planner_calendar(c, calendar);
+    if (p) c->selected = calendar;
+    return p;
+}
+
+int planner_calendar_selected(const PlannerCalendars *c) {
+    return c->selected;
+}
+
+static int agenda_collect(const PlannerEvent *e, int index, void *ctx) {
+    (void)e;
+    AgendaJob *job = ctx;
+    if (job->count == job->capacity) {
+        int capacity = job->capacity ? job->capacity * 2 : 256;
+        int *matches = realloc(job->matches, (size_t)capacity * sizeof(int));
+        if (!matches) {
+            job->ok = 0;
+            return 0;
+        }
+        job->matches = matches;
+        job->capacity = capacity;
+    }
+    job->matches[job->count++] = index;
+    return 1;
+}
+
+// Query one calendar and put its matches in date and time order for the
+// merge. Only the matches are sorted; the calendar keeps the order its user
+// chose. A ParallelTask on AgendaJob items.
+static void run_agenda_job(void *arg) {
+    AgendaJob *job = arg;
+    job->ok = 1;
+    planner_query(job->planner, job->query, agenda_collect, job);
+
+    int count;
+    const PlannerEvent *events = planner_events(job->planner, &count);
+    int sorted = 1;
+    for (int i = 1; sorted && i < job->count; i++) {
+        sorted = packed_time(&events[job->matches[i - 1]]) <= packed_time(&events[job->matches[i]]);
+    }
+    if (!job->ok || sorted) return;
+
+    // (time, index) keys keep events at the same time in calendar order
+    uint64_t *keys = malloc((size_t)job->count * sizeof(uint64_t));
+    if (!keys) {
+        job->ok = 0;
+        return;
+    }
+    for (int i = 0; i < job->count; i++) {
+        keys[i] = (uint64_t)packed_time(&events[job->matches[i]]) << 32 | (uint32_t)job->matches[i];
+    }
+    qsort(keys, (size_t)job->count, sizeof(uint64_t), compare_u64);
+    for (int i = 0; i < job->count; i++) {
+        job->matches[i] = (int)(uint32_t)keys[i];
+    }
+    free(keys);
+}
+
+// Min-heap of calendars ordered by the time of their next match
+typedef struct {
+    uint32_t time;
+    int job;
+} AgendaCursor;
+
+static int agenda_cursor_before(AgendaCursor a, AgendaCursor b) {
+    return a.time < b.time || (a.time == b.time && a.job < b.job);
+}
+
+static void agenda_sift_down(AgendaCursor *heap, int size, int i) {
+    while (1) {
+        int smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < size && agenda_cursor_before(heap[left], heap[smallest])) smallest = left;
+        if (right < size && agenda_cursor_before(heap[right], heap[smallest])) smallest = right;
+        if (smallest == i) return;
+        AgendaCursor tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+int planner_agenda(PlannerCalendars *c, const int *calendars, int count, const PlannerQuery *q,
+                   PlannerAgendaCallback cb, void *ctx) {
+    int selected[MAX_CALENDARS];
+    unsigned char pinned[MAX_CALENDARS] = {0};
+    int job_count = 0;
+    if (!calendars) count = c->count;
+    for (int i = 0; i < count; i++) {
+        int calendar = calendars ? calendars[i] : i;
+        if (calendar < 0 || calendar >= c->count || pinned[calendar]) continue;
+        pinned[calendar] = 1;
+        selected[job_count++] = calendar;
+    }
+    if (job_count == 0) return 0;
+
+    // Open every calendar first; none is evicted until the merge is done
+    AgendaJob jobs[MAX_CALENDARS];
+    memset(jobs, 0, sizeof(jobs));
+    for (int j = 0; j < job_count; j++) {
+        jobs[j].planner = use_calendar(c, selected[j]);
+        jobs[j].query = q;
+    }
+
+    // Calendars that failed to open are skipped
+    AgendaJob *runnable = jobs;
+    int runnable_count = 0;
+    for (int j = 0; j < job_count; j++) {
+        if (jobs[j].planner) {
+            jobs[runnable_count] = jobs[j];
+            selected[runnable_count++] = selected[j];
+        }
+    }
+    if (runnable_count == 0) return 0;
+
+    // Fan the query out over the calendars in parallel
+    run_parallel(run_agenda_job, runnable, sizeof(AgendaJob), runnable_count);
+
+    // Stream a k-way merge of the per-calendar matches
+    AgendaCursor heap[MAX_CALENDARS];
+    int position[MAX_CALENDARS] = {0};
+    const PlannerEvent *events[MAX_CALENDARS];
+    int heap_size = 0, found = 0;
+    for (int j = 0; j < runnable_count; j++) {
+        int n;
+        events[j] = planner_events(runnable[j].planner, &n);
+        if (!runnable[j].ok) {
+            set_calendars_message(c, "Not enough memory to search calendar %s.",
+                                  c->calendars[selected[j]].name);
+        }
+        if (runnable[j].count > 0) {
+            heap[heap_size++] = (AgendaCursor){packed_time(&events[j][runnable[j].matches[0]]), j};
+        }
+    }
+    for (int i = heap_size / 2 - 1; i >= 0; i--) {
+        agenda_sift_down(heap, heap_size, i);
+    }
+
+    while (heap_size > 0) {
+        int j = heap[0].job;
+        int index = runnable[j].matches[position[j]++];
+        found++;
+        if (cb && !cb(&events[j][index], selected[j], index, ctx)) break;
+
+        if (position[j] < runnable[j].count) {
+            heap[0].time = packed_time(&events[j][runnable[j].matches[position[j]]]);
+        } else {
+            heap[0] = heap[--heap_size];
+        }
+        agenda_sift_down(heap, heap_size, 0);
+    }
+
+    for (int j = 0; j < runnable_count; j++) {
+        free(runnable[j].matches);
+    }
+    enforce_memory_cap(c, NULL);
+    return found;
+}
@@ -0,0 +1,201 @@
+#ifndef PLANNER_ENGINE_H
+#define PLANNER_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Embeddable schedule engine. All state lives behind a Planner handle, so
+// several schedules can be open at once and nothing here reads stdin or
+// writes to stdout. Functions returning int use 1 for success and 0 for
+// failure unless noted; planner_last_message() explains the last failure
+// or warning.
+
+#define PLANNER_DESCRIPTION_SIZE 200  // Larger description field
+#define PLANNER_CATEGORY_SIZE 50
+
+typedef struct {
+    int64_t id;               // node_id << 32 | sequence number within the node
+    int day, month, year;
+    int hour, minute;
+    char description[PLANNER_DESCRIPTION_SIZE];
+    int priority;  // New: 1-5 priority level
+    char category[PLANNER_CATEGORY_SIZE];  // New: category field
+} PlannerEvent;
+
+typedef struct Planner Planner;
+
+typedef enum {
+    PLANNER_SORT_DATE,
+    PLANNER_SORT_PRIORITY
+} PlannerSortOrder;
+
+// Filters for planner_query. Zeroed fields match everything. When a date
+// range is given only the months it covers are loaded.
+typedef struct {
+    int from_day, from_month, from_year;  // Inclusive start date
+    int to_day, to_month, to_year;        // Inclusive end date
+    const char *keyword;      // Case-insensitive, in description or category
+    const char *category;     // Case-insensitive, in category
+    int min_priority, max_priority;
+} PlannerQuery;
+
+// Called for each match with its index in planner_events(); return 0 to stop
+typedef int (*PlannerEventCallback)(const PlannerEvent *e, int index, void *ctx);
+
+typedef struct {
+    int partitions_compared;
+    int partitions_differed;
+    int added_here, updated_here, deleted_here;
+    int sent;                 // Changes written to the other copy
+    int conflicts;
+} PlannerSyncReport;
+
+// Called for each sync conflict; theirs is the other copy's version, if any
+typedef void (*PlannerConflictCallback)(int64_t id, const char *reason, const PlannerEvent *theirs, void *ctx);
+
+// Open the schedule stored in dir (created on first save). Only the manifest
+// and the current month are read. Returns NULL if memory runs out.
+Planner *planner_open(const char *dir);
+// Release the handle without saving
+void planner_close(Planner *p);
+int planner_save(Planner *p);
+const char *planner_last_message(const Planner *p);
+void planner_clear_message(Planner *p);
+
+int planner_validate_date(int day, int month, int year);
+int planner_validate_time(int hour, int minute);
+int planner_validate_event(const PlannerEvent *e);
+
+// Add count events after validating all of them; nothing is added if any is
+// invalid. New IDs are written back into events. Returns the number added.
+int planner_add_many(Planner *p, PlannerEvent *events, int count);
+// Delete by ID in a single pass. Returns the number of events deleted.
+int planner_delete_many(Planner *p, const int64_t *ids, int count);
+// Replace the event with the same ID
+int planner_update(Planner *p, const PlannerEvent *e);
+
+// Stream matching events to cb. Returns the number of matches.
+int planner_query(Planner *p, const PlannerQuery *q, PlannerEventCallback cb, void *ctx);
+// A ranked fuzzy search result
+typedef struct {
+    int index;                // Position in planner_events()
+    double score;             // Higher is better
+} PlannerMatch;
+
+// Typo-tolerant search over descriptions and categories. Each word of text
+// may match a word with a few typos or as a prefix; results are ranked by
+// match quality, priority and closeness to today, and the best k are written
+// to results in descending order. Returns the number of results.
+int planner_fuzzy_search(Planner *p, const char *text, PlannerMatch *results, int k);
+// Workload histograms over the whole schedule, computed in one parallel
+// pass. Months run from first_year/first_month for month_count months.
+typedef struct {
+    int total;
+    int first_year, first_month;
+    int month_count;
+    int category_count;
+    char (*categories)[PLANNER_CATEGORY_SIZE];  // Sorted by name ("" = no category)
+    int *category_month;      // [category * month_count + month]
+    int *priority_month;      // [(priority - 1) * month_count + month]
+    int weekday_hour[7][24];  // Weekday 0 is Monday
+} PlannerReport;
+
+int planner_report(Planner *p, PlannerReport *report);
+void planner_free_report(PlannerReport *report);
+
+// An event that duplicates an older one at the same date and time
+typedef struct {
+    int64_t keep_id;
+    int keep_index;           // Oldest event of the group
+    int64_t duplicate_id;
+    int duplicate_index;      // Indices are positions in planner_events()
+    double similarity;        // Estimated similarity of the texts (1 = same)
+    int exact;                // Same category and description once normalized
+} PlannerDuplicate;
+
+// Find exact and near duplicates across the schedule without comparing
+// every pair. Results are grouped by keep_id, and each duplicate is similar
+// to its keep_id event itself, not just to another duplicate of it. Free
+// *pairs with free().
+int planner_find_duplicates(Planner *p, PlannerDuplicate **pairs, int *count);
+// ID of the existing event that e would duplicate (0 if none)
+int64_t planner_find_duplicate_of(Planner *p, const PlannerEvent *e, double *similarity);
+
+// Load every month; needed before walking planner_events() as a whole
+int planner_load_all(Planner *p);
+// Resident events; valid until the next call that changes the schedule
+PlannerEvent *planner_events(Planner *p, int *count);
+int planner_total_count(const Planner *p);
+void planner_sort(Planner *p, PlannerSortOrder order);
+int planner_compare_events(const void *a, const void *b);
+
+// Snapshot of the whole schedule as one compressed, encrypted buffer, and
+// the reverse (which replaces the current events). Free the buffer with free().
+int planner_save_buffer(Planner *p, char **data, size_t *len);
+int planner_load_buffer(Planner *p, const char *data, size_t len);
+
+int planner_compression(const Planner *p);
+void planner_set_compression(Planner *p, int enabled);
+int planner_node_id(const Planner *p);
+
+// Merge with the copy in peer_dir, both ways. A copy found sharing the
+// other's node ID (a directory copied before opening detected it) first
+// takes a new one, renumbering the events it created since they split.
+int planner_sync(Planner *p, const char *peer_dir, PlannerSyncReport *report,
+                 PlannerConflictCallback on_conflict, void *ctx);
+
+// Several processes may use the same directory. Saves hold an exclusive
+// lock and first merge whatever another process saved, so nothing is
+// silently overwritten. planner_watch_fd() becomes readable when files in
+// the directory change (-1 if inotify is unavailable); planner_reload() then
+// merges only the changed months and records into memory, reporting like a
+// sync with conflicts resolved in favour of unsaved local edits. Returns 1
+// if anything changed, 0 if not.
+int planner_watch_fd(const Planner *p);
+int planner_reload(Planner *p, PlannerSyncReport *report,
+                   PlannerConflictCallback on_conflict, void *ctx);
+
+// Several named calendars under one directory. The schedule in the
+// directory itself is the calendar "main" (always index 0); the others live
+// in calendars/<name>, sorted by name. A calendar is opened on first use, and
+// the least recently used ones without unsaved changes are closed whenever
+// the events resident across all calendars would exceed memory_cap bytes.
+typedef struct PlannerCalendars PlannerCalendars;
+
+// Called for each event of a combined agenda, in date and time order.
+// index is the event's position in planner_events() of its calendar.
+typedef int (*PlannerAgendaCallback)(const PlannerEvent *e, int calendar, int index, void *ctx);
+
+PlannerCalendars *planner_calendars_open(const char *dir, size_t memory_cap);
+// Release every calendar without saving
+void planner_calendars_close(PlannerCalendars *c);
+// Save every open calendar
+int planner_calendars_save(PlannerCalendars *c);
+const char *planner_calendars_last_message(const PlannerCalendars *c);
+void planner_calendars_clear_message(PlannerCalendars *c);
+
+int planner_calendar_count(const PlannerCalendars *c);
+const char *planner_calendar_name(const PlannerCalendars *c, int calendar);
+// Index of the named calendar, or -1
+int planner_calendar_find(const PlannerCalendars *c, const char *name);
+// Events in an open calendar, or -1 if it is not loaded
+int planner_calendar_event_count(const PlannerCalendars *c, int calendar);
+// Create an empty calendar. Returns its index, or -1.
+int planner_calendar_create(PlannerCalendars *c, const char *name);
+// Handle of a calendar, opened if needed (NULL on failure). It stays valid
+// until the calendar is evicted; the selected calendar never is.
+Planner *planner_calendar(PlannerCalendars *c, int calendar);
+Planner *planner_calendar_select(PlannerCalendars *c, int calendar);
+int planner_calendar_selected(const PlannerCalendars *c);
+// Run q on the given calendars (all of them when calendars is NULL) in
+// parallel, then stream the matches to cb merged into date and time order.
+// The calendars themselves are not reordered. Returns the number of
+// matches.
+int planner_agenda(PlannerCalendars *c, const int *calendars, int count, const PlannerQuery *q,
+                   PlannerAgendaCallback cb, void *ctx);
+
+// Plain (unencrypted) compressed container files, used for exports
+int planner_write_compressed_file(const char *path, const char *data, size_t len);
+int planner_read_compressed_file(const char *path, char **data, size_t *len);
+
+#endif